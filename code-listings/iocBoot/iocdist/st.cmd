@@ -9,9 +9,29 @@ prng_registerRecordDeviceDriver pdbbase
 
 createPrng(0,34342,"Uniform")
 createPrng(1,34342,"Gaussian")
+## 4 channels with correlation 0.5 between them
+createPrng(2,34342,"Gaussian",4,0.5)
+## New blocks at 10Hz, for records with SCAN=I/O Intr.
+## May be changed, or stopped with 0, after iocInit.
+setPrngRate(2,10)
+## Publish every sample to shared memory.  Follow with 'shmringBench /prng'
+#prngShmPublish("/prng", 65536)
 
-dbLoadRecords("db/prng.db","P=prng:unif,D=Random Distribution,S=#C0 S0 @")
-dbLoadRecords("db/prng.db","P=prng:gaus,D=Random Distribution,S=#C1 S0 @")
+## Doubles straight from the drivers: [0,1) for Uniform, and mean 0,
+## sigma 1 for Gaussian.  prngdist.db defaults to LINR=NO CONVERSION.
+dbLoadRecords("db/prngdist.db","P=prng:unif,S=#C0 S0 @")
+dbLoadRecords("db/prngdist.db","P=prng:gaus,S=#C1 S0 @")
+dbLoadRecords("db/prngdist.db","P=prng:corr0,S=#C2 S0 @,SCAN=I/O Intr")
+dbLoadRecords("db/prngdist.db","P=prng:corr1,S=#C2 S1 @,SCAN=I/O Intr")
+dbLoadRecords("db/prngdist.db","P=prng:corr2,S=#C2 S2 @,SCAN=I/O Intr")
+dbLoadRecords("db/prngdist.db","P=prng:corr3,S=#C2 S3 @,SCAN=I/O Intr")
+dbLoadRecords("db/prngarray.db","P=prng:unif:array,D=Random Distribution,S=#C0 S0 @,SCAN=1 second")
+
+## Statistics of every sample generated by each instance.  An instance
+## with setPrngRate() keeps generating, and updating these, while its
+## value records are scanned slowly or disabled.
+dbLoadRecords("db/prngstats.db","P=prng:unif:stats,NAME=dist0")
+dbLoadRecords("db/prngstats.db","P=prng:gaus:stats,NAME=dist1")
 
 cd ${TOP}/iocBoot/${IOC}
 iocInit
@@ -13,7 +13,30 @@ msim_registerRecordDeviceDriver(pdbbase)
 
 addmsim(0, -1000, 1000, 2.0)
 
+## Run simulated time 20x faster than real time (for test suites)
+#msimClock(-1, 20, 0)
+## Or advance exactly 0.5 sec of simulated time per poll, 20 polls/sec
+#msimClock(-1, 10, 0.5)
+
+## Drop missed polls instead of running them late.
+## See how late polls run with 'msimLateness(-1, 0)'
+#msimSchedule(-1, "skip", 0)
+
+## Publish positions to shared memory.  Follow with 'shmringBench /msim'
+#msimShmPublish("/msim", 4096)
+
 dbLoadRecords("db/motor.db","P=test:,M=msim")
 
+## 1000 encoder samples per simulated second, as one waveform per poll
+#msimEncoder(0, 1000, 0)
+#dbLoadRecords("db/encoder.db","P=test:,M=msim,NELM=1000")
+
+## Each controller is simulated by a thread "msim<id>".  Place them
+## with the "msim" group, one CPU each of 1-3, away from the CA server.
+#threadPolicy("msim", "1-3", "FIFO", 50, 1)
+
 cd(${TOP}/iocBoot/${IOC})
 iocInit()
+
+## Motor records are then processed on the high priority callback thread
+#threadPlace("cbHigh", "1", "FIFO", 50)
@@ -0,0 +1,26 @@
+#!../../bin/linux-x86/msim
+
+## Soak test of a large fleet of simulated motors
+
+< envPaths
+
+cd("${TOP}")
+
+## Register all support components
+dbLoadDatabase("dbd/msim.dbd")
+msim_registerRecordDeviceDriver(pdbbase)
+
+## Large fleets queue many updates at once
+#callbackSetQueueSize(20000)
+
+## 500 axes named soak:m0 ... soak:m499 polling at 2Hz.
+## 50 axes per simulated controller thread.
+addmsimFleet("soak:", 500, -1000, 1000, 2.0, 50)
+
+cd(${TOP}/iocBoot/${IOC})
+iocInit()
+
+## 100 random commands per second within +-900 steps, for 10 minutes.
+## Prints moves/sec, command to DMOV time, priorityHigh queue delay
+## and CPU use every 10 seconds.
+msimSoak("soak:", 500, 100, 900, 600)
@@ -6,11 +6,57 @@ cd "../.."
 dbLoadDatabase "dbd/prng.dbd"
 prng_registerRecordDeviceDriver pdbbase
 
+## Allow "Random Intr Rate" to queue up to 4 values ahead.
+## Use 'dbior devAiPrngIntrRate' to see the achieved rate.
+#var prngIntrRateWindow 4
+#var prngIntrRateDelay 0
+
+## Generators with no enabled I/O Intr records are parked until a
+## record is added or its DISA/DISV is written.  Set a period (sec)
+## to also poll, if DISA is changed without posting a monitor.
+## 'dbior devAiPrngIntr 1' shows wakeups/sec of each generator.
+#var prngIdleCheck 0
+
+## Spread I/O Intr generator workers over CPUs 2-7 with SCHED_FIFO
+#threadPolicy("prng", "2-7", "FIFO", 20, 1)
+## Compare wakeup jitter of 1ms periodic threads
+#threadJitter("", "", 0, 0.001, 5000)
+#threadJitter("1", "FIFO", 50, 0.001, 5000)
+
 ## Load record instances
 dbLoadRecords("db/prng.db","P=test:prng,D=Random,S=324235")
 dbLoadRecords("db/prng.db","P=test:prngasync,D=Random Async,S=324235")
 dbLoadRecords("db/prng.db","P=test:prngintr,D=Random Intr,SCAN=I/O Intr,S=324235")
+## One 1kHz generator, shared by records with the same seed and period.
+## test:prngfast is scanned for every value.  The displays are scanned
+## at 1Hz with the mean, and the max, of each 1000 values.
+dbLoadRecords("db/prng.db","P=test:prngfast,D=Random Intr Decim,SCAN=I/O Intr,S='@324235 period=0.001'")
+dbLoadRecords("db/prng.db","P=test:prngdecim,D=Random Intr Decim,SCAN=I/O Intr,S='@324235 period=0.001 decim=1000 reduce=mean'")
+dbLoadRecords("db/prng.db","P=test:prngdecimmax,D=Random Intr Decim,SCAN=I/O Intr,S='@324235 period=0.001 decim=1000 reduce=max'")
 dbLoadRecords("db/prng.db","P=test:prngrate,D=Random Intr Rate,SCAN=I/O Intr,S=324235,TPRO=1")
+## Same as test:prng with a different PRNG engine
+dbLoadRecords("db/prng.db","P=test:prngpcg,D=Random Engine,S='@324235 engine=pcg32'")
+## 10000 values every second in one array
+dbLoadRecords("db/prngarray.db","P=test:prngarray,D=Random Intr,S='@324235 period=1.0'")
+## Integer records read the same generators without ai conversion.
+## This longin is scanned with test:prngintr, from the same generator.
+dbLoadRecords("db/prngint.db","P=test:prngli,RTYP=longin,D=Random Intr,SCAN=I/O Intr,S=324235")
+## Statistics of every sample generated.  test:prngintr could
+## be disabled without affecting these.
+dbLoadRecords("db/prngstats.db","P=test:prngintr:stats,NAME=test:prngintr")
 
 cd ${TOP}/iocBoot/${IOC}
 iocInit
+
+## Print counters and rates with 'perfCounters ""' or 'dbior'.
+## Append them to a CSV file every 10 seconds.
+#perfCountersDump("/tmp/prng-counters.csv", 10, "csv")
+
+## Record events for a while, then write a trace for chrome://tracing or Perfetto
+#evTraceOn
+#epicsThreadSleep 5
+#evTraceDump("/tmp/prng-trace.json")
+
+## Slow the generators down whenever any callback queue delays
+## work by more than 10 ms.  See the effect with 'prngGovStatus'
+#prngGovernor(0.01, 1.0)
@@ -0,0 +1,28 @@
+#!../../bin/linux-x86/prng
+
+## Startup time, memory and threads for 50k "Random Intr" records.
+## Records with the same seed share one generator thread,
+## so compare nkeys=50000 (one per record) with nkeys=10.
+
+< envPaths
+
+cd ${TOP}
+
+dbLoadDatabase "dbd/prng.dbd"
+prng_registerRecordDeviceDriver pdbbase
+
+prngBench("bench:", 50000, 10)
+## Or 5000 "Random Async Sched" records, each waiting 0.1 sec at 10Hz
+## on the shared delay queue.
+## Watch the callback rate with 'perfCounters devAiPrngAsync'
+#prngBench("bench:", 5000, 0, "Random Async Sched")
+## Run again with the per-record timers of the tutorial "Random Async",
+## and compare the prngBenchReport output below.
+#prngBench("bench:", 5000, 0, "Random Async")
+
+cd ${TOP}/iocBoot/${IOC}
+iocInit
+
+## CPU time and memory after a minute of running
+#epicsThreadSleep 60
+#prngBenchReport
@@ -0,0 +1,22 @@
+#!../../bin/linux-x86/sum
+
+< envPaths
+
+cd ${TOP}
+
+## Register all support components
+dbLoadDatabase "dbd/sum.dbd"
+sum_registerRecordDeviceDriver pdbbase
+
+## One group of 4 inputs
+createSumGroup("grp", 4)
+
+## Same alarm limits as starting/sum-alarm.db
+dbLoadRecords("db/sumstats.db","INST=calc,G=grp")
+dbLoadRecords("db/suminput.db","INST=calc,G=grp,N=0")
+dbLoadRecords("db/suminput.db","INST=calc,G=grp,N=1")
+dbLoadRecords("db/suminput.db","INST=calc,G=grp,N=2")
+dbLoadRecords("db/suminput.db","INST=calc,G=grp,N=3")
+
+cd ${TOP}/iocBoot/${IOC}
+iocInit
@@ -1,23 +1,45 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 
 #include <dbDefs.h>
 #include <ellLib.h>
 #include <devSup.h>
 #include <recSup.h>
 #include <recGbl.h>
+#include <alarm.h>
 #include <callback.h>
 #include <initHooks.h>
 #include <dbAccess.h>
+#include <dbScan.h>
 #include <epicsExport.h>
 #include <cantProceed.h>
 #include <devLib.h>
 #include <iocsh.h>
 #include <epicsTime.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsVersion.h>
 
 #include <motorRecord.h>
 #include <motor.h>
+#include <waveformRecord.h>
+#include <menuFtype.h>
+
+#include "evtrace.h"
+#include "perfcount.h"
+#include "threadplace.h"
+#include "shmring.h"
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,15,0,1)
+#  define USE_ATOMIC
+#  include <epicsAtomic.h>
+#endif
+#endif
 
 /* Simulated hardware state */
 struct hardware {
@@ -32,7 +54,66 @@ struct hardware {
 	int moving:1;
 	epicsInt32 remaining;
 
-	epicsTimeStamp last;
+	/* current move */
+	epicsInt32 start; /* position when started */
+	epicsInt32 distance; /* signed */
+	double started; /* simulated time when started */
+};
+
+/* Simulated time.
+ * Runs at 'scale' times real time, or if 'step' is non-zero,
+ * advances by 'step' seconds on each poll.
+ */
+struct simclock {
+	double scale;
+	double step;
+
+	double now; /* seconds */
+	epicsTimeStamp real; /* real time of last update */
+};
+
+/* Poll deadlines are base+n*period, so a late poll does not
+ * delay the ones after it.  Polls missed by up to 'maxlag'
+ * periods are run back to back.  Beyond that, or always
+ * with 'skip', they are dropped.
+ */
+struct schedule {
+	int skip;
+	double maxlag; /* periods */
+
+	epicsTimeStamp base;
+	double period; /* real sec. between polls */
+	unsigned long ticks;
+};
+
+/* How late polls ran.  bins[0] counts <1 us, bins[i] [2^(i-1), 2^i) us */
+enum {late_nbins=24};
+
+struct latestats {
+	unsigned long polls, skipped;
+	double max; /* sec. */
+	unsigned long bins[late_nbins];
+};
+
+/* Dense position/velocity samples of an axis, computed for the
+ * time since the previous poll and published once per poll.
+ */
+enum {enc_pos, enc_vel, enc_time, enc_nsig};
+
+struct encoder {
+	double rate; /* samples per simulated second */
+	double next; /* simulated time of the next sample */
+	epicsUInt32 nelm; /* samples per poll, at most */
+
+	/* owned by the controller thread */
+	double *fill[enc_nsig];
+	epicsUInt32 nfill;
+
+	/* guarded by ctrl->lock */
+	double *ready[enc_nsig];
+	epicsUInt32 nready;
+
+	IOSCANPVT scan;
 };
 
 enum {max_targs=2};
@@ -48,43 +129,130 @@ struct trans {
 	trans_proc_t trans_proc;
 };
 
+struct controller;
+
 /* Device support private */
 struct devsim {
 	ELLNODE node;
 
+	/* Owned by the controller thread */
 	struct hardware hw;
+	struct simclock clock;
+	epicsTimeStamp next; /* next poll */
+	struct schedule sched;
+	struct latestats late;
+	int lateReset; /* set by msimLateness() */
+	int publishNow;
 
 	int id;
 
 	double rate; /* poll rate */
 
+	struct encoder *enc; /* NULL unless msimEncoder() */
+
+	struct controller *ctrl;
+	ELLNODE ctrlnode; /* in controller::axes */
+
+	/* Snapshot of hw published to the record, guarded by ctrl->lock */
+	struct hardware status;
 	int updateReady;
+	int updatePending;
 	CALLBACK updatecb;
 
 	ELLLIST transaction; /* list of struct trans */
 };
 
+/* One transaction passed from the record to the controller */
+struct command {
+	struct command *next;
+	struct devsim *axis;
+	ELLLIST transaction; /* list of struct trans */
+};
+
+/* Simulated controller.  A thread which owns the hardware
+ * state of a group of axes, and executes the commands
+ * queued to it.
+ */
+struct controller {
+	ELLNODE node;
+
+	int id;
+	char name[20]; /* worker thread name */
+
+	ELLLIST axes; /* list of struct devsim */
+
+	epicsThreadId worker;
+	epicsEventId wakeup;
+	epicsMutexId lock;
+
+	/* Queue of struct command.  Pushed by any thread, emptied by the worker.
+	 * Newest first.
+	 */
+	void *queue;
+#ifndef USE_ATOMIC
+	epicsMutexId queueLock;
+#endif
+};
+
+/* Default for axes created after msimClock(-1, ...) */
+static
+struct simclock defclock = {1.0, 0.0, 0.0, {0,0}};
+
+/* Default for axes created after msimSchedule(-1, ...) */
+static
+struct schedule defsched = {0, 10.0, {0,0}, 0.0, 0};
+
+/* Current simulated time */
 static
-void update_motor(struct hardware *hw)
+double clock_now(struct simclock *clk)
 {
 	epicsTimeStamp now;
+
+	if(clk->step==0.0){
+		epicsTimeGetCurrent(&now);
+		clk->now += epicsTimeDiffInSeconds(&now, &clk->real) * clk->scale;
+		clk->real = now;
+	}
+	return clk->now;
+}
+
+/* Called once for each poll */
+static
+void clock_tick(struct simclock *clk)
+{
+	if(clk->step!=0.0)
+		clk->now += clk->step;
+}
+
+/* Real time between polls to give 'rate' polls per simulated second */
+static
+double clock_period(const struct simclock *clk, double rate)
+{
+	return 1.0/(rate*clk->scale);
+}
+
+/* Position is computed from the start of the move so that
+ * the result depends only on the simulated time, and not
+ * on how often this is called.
+ */
+static
+void update_motor(struct hardware *hw, double now)
+{
 	double ellapsed, moved;
 
 	if(hw->moving){
 
-		epicsTimeGetCurrent(&now);
-
-		ellapsed = epicsTimeDiffInSeconds(&now, &hw->last);
+		ellapsed = now - hw->started;
 	
 		moved = ellapsed * hw->vel;
 	
-		if( fabs(moved) >= fabs(hw->remaining) ){
-			moved = hw->remaining;
+		if( fabs(moved) >= fabs(hw->distance) ){
+			moved = hw->distance;
 			hw->moving = 0;
 		}
 	
-		hw->pos += (epicsInt32)moved;
-		hw->remaining -= (epicsInt32)moved;
+		hw->pos = hw->start + (epicsInt32)moved;
+		hw->remaining = hw->distance - (epicsInt32)moved;
 
 	}
 
@@ -101,9 +269,198 @@ void update_motor(struct hardware *hw)
 		hw->lim_l=0;
 }
 
+static
+struct perfCounter *ntransBuilt, *ntransExecuted, *npolls, *nmoves, *ncallbacks;
+static
+struct perfCounter *nencSamples, *nencDropped;
+static
+struct perfCounter *nlockWaitNs, *nlockHoldNs;
+
+static
+void late_add(struct latestats *st, double late)
+{
+	double us=late*1e6;
+	int bin=0;
+
+	st->polls++;
+	if(late>st->max)
+		st->max=late;
+	if(us>=1.0){
+		(void)frexp(us, &bin);
+		if(bin>=late_nbins)
+			bin=late_nbins-1;
+	}
+	st->bins[bin]++;
+}
+
+/* Start polling at 'now', first poll one period later */
+static
+void schedule_start(struct devsim *priv, const epicsTimeStamp *now)
+{
+	priv->sched.base=*now;
+	priv->sched.period=clock_period(&priv->clock, priv->rate);
+	priv->sched.ticks=1;
+	priv->next=*now;
+	epicsTimeAddSeconds(&priv->next, priv->sched.period);
+}
+
+/* Called when the deadline 'next' has passed.  Record lateness
+ * and advance 'next' to the following deadline.
+ */
+static
+void schedule_next(struct devsim *priv, const epicsTimeStamp *now)
+{
+	struct schedule *sch=&priv->sched;
+	double behind;
+
+	if(priv->lateReset){
+		priv->lateReset=0;
+		memset(&priv->late, 0, sizeof(priv->late));
+	}
+	late_add(&priv->late, epicsTimeDiffInSeconds(now, &priv->next));
+
+	sch->ticks++;
+
+	/* periods by which the new deadline has already passed */
+	behind=epicsTimeDiffInSeconds(now, &sch->base)/sch->period - sch->ticks;
+	if(behind>=0.0 && (sch->skip || behind>=sch->maxlag)){
+		unsigned long n=1+(unsigned long)behind;
+		sch->ticks+=n;
+		priv->late.skipped+=n;
+	}
+
+	priv->next=sch->base;
+	epicsTimeAddSeconds(&priv->next, sch->ticks*sch->period);
+}
+
+/* Position and velocity at simulated time 't' within the
+ * current poll period, by the same formula as update_motor()
+ */
+static
+void sample_motor(const struct hardware *hw, double t, double *pos, double *vel)
+{
+	double moved;
+
+	*pos = hw->pos;
+	*vel = 0.0;
+
+	if(hw->moving && t > hw->started){
+		moved = (t - hw->started) * hw->vel;
+		if( fabs(moved) >= fabs(hw->distance) ){
+			moved = hw->distance;
+		}else
+			*vel = hw->vel;
+		*pos = hw->start + (epicsInt32)moved;
+	}
+
+	if(*pos >= hw->lim_h_val){
+		*pos = hw->lim_h_val;
+		*vel = 0.0;
+	}else if(*pos <= hw->lim_l_val){
+		*pos = hw->lim_l_val;
+		*vel = 0.0;
+	}
+}
+
+/* Sample up to 'now', before update_motor(), then publish the block */
+static
+void encoder_poll(struct devsim *priv, double now)
+{
+	struct encoder *enc=priv->enc;
+	double *tmp[enc_nsig];
+	unsigned i;
+
+	if(enc->next==0.0)
+		enc->next=now;
+
+	for(; enc->next<=now; enc->next+=1.0/enc->rate)
+	{
+		if(enc->nfill>=enc->nelm){
+			perfCounterInc(nencDropped);
+			continue;
+		}
+		sample_motor(&priv->hw, enc->next,
+		             &enc->fill[enc_pos][enc->nfill],
+		             &enc->fill[enc_vel][enc->nfill]);
+		enc->fill[enc_time][enc->nfill]=enc->next;
+		enc->nfill++;
+	}
+
+	epicsMutexMustLock(priv->ctrl->lock);
+	for(i=0; i<enc_nsig; i++){
+		tmp[i]=enc->ready[i];
+		enc->ready[i]=enc->fill[i];
+		enc->fill[i]=tmp[i];
+	}
+	enc->nready=enc->nfill;
+	epicsMutexUnlock(priv->ctrl->lock);
+
+	perfCounterAdd(nencSamples, enc->nfill);
+
+	enc->nfill=0;
+	scanIoRequest(enc->scan);
+}
+
+/* Add to the command queue.  Lock free (Base >= 3.15) */
+static
+void command_push(struct controller *ctrl, struct command *cmd)
+{
+#ifdef USE_ATOMIC
+	EpicsAtomicPtrT head;
+
+	do {
+		head = epicsAtomicGetPtrT(&ctrl->queue);
+		cmd->next = head;
+	} while(epicsAtomicCmpAndSwapPtrT(&ctrl->queue, head, cmd)!=head);
+#else
+	epicsMutexMustLock(ctrl->queueLock);
+	cmd->next = ctrl->queue;
+	ctrl->queue = cmd;
+	epicsMutexUnlock(ctrl->queueLock);
+#endif
+
+	epicsEventSignal(ctrl->wakeup);
+}
+
+/* Remove all queued commands and return them oldest first */
+static
+struct command *command_take(struct controller *ctrl)
+{
+	struct command *cur, *rev=NULL;
+
+#ifdef USE_ATOMIC
+	EpicsAtomicPtrT head;
+
+	do {
+		head = epicsAtomicGetPtrT(&ctrl->queue);
+	} while(head && epicsAtomicCmpAndSwapPtrT(&ctrl->queue, head, NULL)!=head);
+	cur = head;
+#else
+	epicsMutexMustLock(ctrl->queueLock);
+	cur = ctrl->queue;
+	ctrl->queue = NULL;
+	epicsMutexUnlock(ctrl->queueLock);
+#endif
+
+	while(cur) {
+		struct command *next = cur->next;
+		cur->next = rev;
+		rev = cur;
+		cur = next;
+	}
+	return rev;
+}
+
 static
 ELLLIST devices = {{NULL,NULL},0}; /* list of struct devsim */
 
+static
+ELLLIST controllers = {{NULL,NULL},0}; /* list of struct controller */
+
+/* Axis positions are published here, if msimShmPublish() was called */
+static
+struct shmRing *shmring;
+
 static
 struct devsim *getDev(int id)
 {
@@ -119,14 +476,43 @@ struct devsim *getDev(int id)
 	return NULL;
 }
 
+static
+struct controller *getCtrl(int id)
+{
+	ELLNODE *node;
+	struct controller *cur;
+
+	for(node=ellFirst(&controllers); node; node=ellNext(node))
+	{
+		cur=(struct controller*)node;
+		if(cur->id==id)
+			return cur;
+	}
+
+	cur=callocMustSucceed(1, sizeof(*cur), "msim controller");
+	cur->id=id;
+	cur->wakeup=epicsEventMustCreate(epicsEventEmpty);
+	cur->lock=epicsMutexMustCreate();
+#ifndef USE_ATOMIC
+	cur->queueLock=epicsMutexMustCreate();
+#endif
+	ellAdd(&controllers, &cur->node);
+	return cur;
+}
+
 static
 void timercb(CALLBACK* cb);
 
 static
-void addmsim(int id, int llim, int hlim, double rate)
+void addmsim(int id, int llim, int hlim, double rate, int ctrlid)
 {
 	struct devsim *priv=getDev(id);
 
+	/* controller threads are started, and walk their axes, from iocInit */
+	if(interruptAccept){
+		printf("addmsim must be called before iocInit\n");
+		return;
+	}
 	if(!!priv){
 		printf("Id already in use\n");
 		return;
@@ -148,10 +534,49 @@ void addmsim(int id, int llim, int hlim, double rate)
 
 	priv->hw.lim_h_val=hlim;
 	priv->hw.lim_l_val=llim;
+	priv->status=priv->hw;
+
+	priv->clock=defclock;
+	priv->sched=defsched;
+
+	priv->ctrl=getCtrl(ctrlid);
+	ellAdd(&priv->ctrl->axes, &priv->ctrlnode);
 
 	ellAdd(&devices, &priv->node);
 }
 
+/* Create 'count' axes with ids [0, count) and load a
+ * motor record for each, named $(prefix)m<id>.
+ * Each group of 'perctrl' axes shares a controller.
+ */
+static
+void addmsimFleet(const char *prefix, int count, int llim, int hlim, double rate, int perctrl)
+{
+	char macros[128];
+	int i;
+
+	if(interruptAccept){
+		printf("addmsimFleet must be called before iocInit\n");
+		return;
+	}
+	if(!prefix || count<=0){
+		printf("Usage: addmsimFleet <prefix> <count> <low limit> <high limit> <rate> <axes per controller>\n");
+		return;
+	}
+
+	for(i=0; i<count; i++)
+	{
+		if(getDev(i)){
+			printf("Id %d already in use\n", i);
+			continue;
+		}
+		addmsim(i, llim, hlim, rate, perctrl>0 ? i/perctrl : 0);
+
+		epicsSnprintf(macros, sizeof(macros), "P=%s,M=m%d,C=%d", prefix, i, i);
+		dbLoadRecords("db/motor.db", macros);
+	}
+}
+
 static
 long init_record(motorRecord *pmr)
 {
@@ -190,20 +615,147 @@ error:
 	return ret;
 }
 
+/* Copy hardware state for the record, and request processing */
 static
-void inithooks(initHookState state)
+void publish(struct devsim *priv)
+{
+	int request;
+
+	epicsMutexMustLock(priv->ctrl->lock);
+	priv->status=priv->hw;
+	priv->updateReady=1;
+	request=!priv->updatePending;
+	priv->updatePending=1;
+	epicsMutexUnlock(priv->ctrl->lock);
+
+	if(request)
+		callbackRequest(&priv->updatecb);
+}
+
+static
+void execute(struct command *cmd)
+{
+	struct devsim *priv=cmd->axis;
+	ELLNODE *node;
+	struct trans *cur;
+
+	while((node=ellGet(&cmd->transaction))!=NULL)
+	{
+		cur=(struct trans*)node;
+
+		switch(cur->nargs){
+		case 0:
+			(*cur->trans_proc)(priv);
+			break;
+		case 1:
+			(*cur->trans_proc)(priv,
+				cur->args[0]);
+			break;
+		case 2:
+			(*cur->trans_proc)(priv,
+				cur->args[0],
+				cur->args[1]);
+			break;
+		default:
+			printf("Internal Logic error: too many arguments\n");
+		}
+
+		free(cur);
+		perfCounterInc(ntransExecuted);
+	}
+}
+
+static
+void controller_worker(void *raw)
 {
+	struct controller *ctrl=raw;
 	ELLNODE *node;
 	struct devsim *cur;
+	epicsTimeStamp now;
+
+	epicsTimeGetCurrent(&now);
+	for(node=ellFirst(&ctrl->axes); node; node=ellNext(node))
+	{
+		cur=CONTAINER(node, struct devsim, ctrlnode);
+		cur->clock.real=now;
+		schedule_start(cur, &now);
+	}
+
+	while(1) {
+		struct command *cmd;
+		double wait=-1.0;
+
+		EVTRACE_BEGIN("worker", ctrl->name);
+
+		/* apply queued commands in order */
+		cmd=command_take(ctrl);
+		while(cmd)
+		{
+			struct command *next=cmd->next;
+			execute(cmd);
+			free(cmd);
+			cmd=next;
+		}
+
+		epicsTimeGetCurrent(&now);
+
+		for(node=ellFirst(&ctrl->axes); node; node=ellNext(node))
+		{
+			double remain;
+
+			cur=CONTAINER(node, struct devsim, ctrlnode);
+
+			if(epicsTimeDiffInSeconds(&cur->next, &now)<=0.0){
+				schedule_next(cur, &now);
+				clock_tick(&cur->clock);
+				if(cur->enc)
+					encoder_poll(cur, clock_now(&cur->clock));
+				update_motor(&cur->hw, clock_now(&cur->clock));
+				perfCounterInc(npolls);
+				if(shmring)
+					shmRingPut(shmring, cur->id, 0, cur->hw.pos);
+				cur->publishNow=1;
+			}
+
+			if(cur->publishNow){
+				cur->publishNow=0;
+				publish(cur);
+			}
+
+			remain=epicsTimeDiffInSeconds(&cur->next, &now);
+			if(remain<0.0)
+				remain=0.0; /* catching up */
+			if(wait<0.0 || remain<wait)
+				wait=remain;
+		}
+
+		EVTRACE_END("worker", ctrl->name);
+
+		if(wait<0.0)
+			epicsEventMustWait(ctrl->wakeup);
+		else
+			(void)epicsEventWaitWithTimeout(ctrl->wakeup, wait);
+	}
+}
+
+static
+void inithooks(initHookState state)
+{
+	ELLNODE *node;
+	struct controller *cur;
 	/* as of 3.14.11 initHookAtEnd is deprecated and initHookAfterIocRunning is proper */
 	if(state!=initHookAtEnd)
 		return;
 
-	for(node=ellFirst(&devices); node; node=ellNext(node))
+	for(node=ellFirst(&controllers); node; node=ellNext(node))
 	{
-		cur=(struct devsim*)node;
+		cur=(struct controller*)node;
 
-		callbackRequestDelayed(&cur->updatecb, 1.0/cur->rate);
+		epicsSnprintf(cur->name, sizeof(cur->name), "msim%d", cur->id);
+		cur->worker=epicsThreadMustCreate(cur->name, epicsThreadPriorityHigh,
+			epicsThreadGetStackSize(epicsThreadStackSmall),
+			&controller_worker, cur);
+		threadPlaceApply(cur->worker, "msim");
 	}
 }
 
@@ -213,21 +765,38 @@ void timercb(CALLBACK* cb)
 	motorRecord *pmr=NULL;
 	struct rset* rset=NULL;
 	struct devsim *priv=NULL;
+	epicsTimeStamp t0, t1, t2;
 
 	callbackGetUser(pmr,cb);
+	if(!pmr)
+		return; /* no record for this axis */
 	priv=pmr->dpvt;
 	rset=(struct rset*)pmr->rset;
 
-	dbScanLock((dbCommon*)pmr);
+	EVTRACE_BEGIN("timercb", pmr->name);
+	perfCounterInc(ncallbacks);
 
-	callbackRequestDelayed(&priv->updatecb, 1.0/priv->rate);
+	epicsMutexMustLock(priv->ctrl->lock);
+	priv->updatePending=0;
+	epicsMutexUnlock(priv->ctrl->lock);
 
-	update_motor(&priv->hw);
-	priv->updateReady=1;
+	/* Only the snapshot copy and record processing happen
+	 * under the record lock.  The simulation step was done by
+	 * the controller thread.
+	 */
+	epicsTimeGetCurrent(&t0);
+	dbScanLock((dbCommon*)pmr);
+	epicsTimeGetCurrent(&t1);
 
 	(*rset->process)(pmr);
 
+	epicsTimeGetCurrent(&t2);
 	dbScanUnlock((dbCommon*)pmr);
+
+	perfCounterAdd(nlockWaitNs, (size_t)(epicsTimeDiffInSeconds(&t1, &t0)*1e9));
+	perfCounterAdd(nlockHoldNs, (size_t)(epicsTimeDiffInSeconds(&t2, &t1)*1e9));
+
+	EVTRACE_END("timercb", pmr->name);
 }
 
 static
@@ -235,20 +804,26 @@ CALLBACK_VALUE update_values(motorRecord *pmr)
 {
 	struct devsim *priv=pmr->dpvt;
 	msta_field modsts;
+	struct hardware status;
 
-	if(!priv->updateReady)
+	epicsMutexMustLock(priv->ctrl->lock);
+	if(!priv->updateReady){
+		epicsMutexUnlock(priv->ctrl->lock);
 		return NOTHING_DONE;
+	}
 	priv->updateReady=0;
+	status=priv->status;
+	epicsMutexUnlock(priv->ctrl->lock);
 
 	modsts.All=pmr->msta;
 
-	modsts.Bits.RA_PLUS_LS = priv->hw.lim_h;
-	modsts.Bits.RA_MINUS_LS = priv->hw.lim_l;
-	modsts.Bits.RA_DONE = !priv->hw.moving;
+	modsts.Bits.RA_PLUS_LS = status.lim_h;
+	modsts.Bits.RA_MINUS_LS = status.lim_l;
+	modsts.Bits.RA_DONE = !status.moving;
 
 	pmr->msta=modsts.All;
 
-	pmr->rmp = (double)priv->hw.pos;
+	pmr->rmp = (double)status.pos;
 
 	return CALLBACK_DATA;
 }
@@ -273,45 +848,37 @@ long start_trans(struct motorRecord *pmr)
 	return 0;
 }
 
+/* The following are run by the controller thread */
+
 static
-void move_rel(motorRecord *pmr, double rel)
+void move_rel(struct devsim *priv, double rel)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	priv->hw.remaining = (epicsInt32)rel;
 }
 
 static
-void move_abs(motorRecord *pmr, double newpos)
+void move_abs(struct devsim *priv, double newpos)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	newpos -= (double)priv->hw.pos;
 
-	move_rel(pmr, newpos);
+	move_rel(priv, newpos);
 }
 
 static
-void set_velocity(motorRecord *pmr, double vel)
+void set_velocity(struct devsim *priv, double vel)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	priv->hw.vel = vel;
 }
 
 static
-void load_pos(motorRecord *pmr, double newpos)
+void load_pos(struct devsim *priv, double newpos)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	priv->hw.pos = (epicsInt32)newpos;
 }
 
 static
-void go(motorRecord *pmr)
+void go(struct devsim *priv)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	/* Simulation start */
 
 	if(!priv->hw.remaining)
@@ -324,17 +891,18 @@ void go(motorRecord *pmr)
 	priv->hw.vel = copysign(priv->hw.vel, priv->hw.remaining);
 
 	priv->hw.moving=1;
-	epicsTimeGetCurrent(&priv->hw.last);
+	priv->hw.start=priv->hw.pos;
+	priv->hw.distance=priv->hw.remaining;
+	priv->hw.started=clock_now(&priv->clock);
+	perfCounterInc(nmoves);
 
 	/* update record */
-	callbackRequest(&priv->updatecb);
+	priv->publishNow=1;
 }
 
 static
-void stop(motorRecord *pmr)
+void stop(struct devsim *priv)
 {
-	struct devsim *priv=pmr->dpvt;
-
 	/* Simulation stop */
 
 	if(!priv->hw.moving)
@@ -344,7 +912,7 @@ void stop(motorRecord *pmr)
 	priv->hw.remaining=0;
 
 	/* update record */
-	callbackRequest(&priv->updatecb);
+	priv->publishNow=1;
 }
 
 static
@@ -396,52 +964,142 @@ RTN_STATUS build_trans(motor_cmnd cmd, double *val, struct motorRecord *pmr)
 	}
 
 	ellAdd(&priv->transaction, &t->node);
+	perfCounterInc(ntransBuilt);
 
 	return OK;
 }
 
+/* Hand the transaction to the controller thread.
+ * Does not touch the hardware state.
+ */
 static
 RTN_STATUS end_trans(struct motorRecord *pmr)
 {
 	struct devsim *priv=pmr->dpvt;
-	ELLNODE *node, *next;
-	struct trans *cur;
+	struct command *cmd;
 
-	for(node=ellFirst(&priv->transaction), next = node ? ellNext(node) : NULL;
-		node;
-		node=next, next= next ? ellNext(next) : NULL )
-	{
-		cur=(struct trans*)node;
+	EVTRACE_MARK("end_trans", pmr->name);
 
-		switch(cur->nargs){
-		case 0:
-			(*cur->trans_proc)(pmr);
-			break;
-		case 1:
-			(*cur->trans_proc)(pmr,
-				cur->args[0]);
-			break;
-		case 2:
-			(*cur->trans_proc)(pmr,
-				cur->args[0],
-				cur->args[1]);
-		default:
-			printf("Internal Logic error: too many arguments\n");
-			return ERROR;
-		}
+	if(ellCount(&priv->transaction)==0)
+		return OK;
 
-		ellDelete(&priv->transaction, node);
-		free(cur);
-	}
+	cmd=callocMustSucceed(1, sizeof(*cmd), "end_trans");
+	cmd->axis=priv;
+	ellConcat(&cmd->transaction, &priv->transaction);
+
+	command_push(priv->ctrl, cmd);
 
 	return OK;
 }
 
+static
+long init(int phase)
+{
+	if(phase==0){
+		ntransBuilt=perfCounterGet("devMSIM.transBuilt");
+		ntransExecuted=perfCounterGet("devMSIM.transExecuted");
+		npolls=perfCounterGet("devMSIM.polls");
+		nmoves=perfCounterGet("devMSIM.moves");
+		ncallbacks=perfCounterGet("devMSIM.callbacks");
+		nencSamples=perfCounterGet("devMSIM.encSamples");
+		nencDropped=perfCounterGet("devMSIM.encDropped");
+		nlockWaitNs=perfCounterGet("devMSIM.lockWaitNs");
+		nlockHoldNs=perfCounterGet("devMSIM.lockHoldNs");
+	}
+	return 0;
+}
+
+static
+long report(int level)
+{
+	size_t ncb=perfCounterRead(ncallbacks);
+
+	perfCounterReport("devMSIM.", level);
+	if(ncb)
+		printf("  record lock per callback: mean wait %.0f ns, mean hold %.0f ns\n",
+		       (double)perfCounterRead(nlockWaitNs)/ncb,
+		       (double)perfCounterRead(nlockHoldNs)/ncb);
+	return 0;
+}
+
+/* Encoder stream waveforms.  INP "#C<id> S<n> @" where
+ * S0 is position, S1 velocity, and S2 simulated time
+ */
+static
+long init_record_enc(waveformRecord *prec)
+{
+	struct devsim *priv=getDev(prec->inp.value.vmeio.card);
+
+	if(!priv || !priv->enc){
+		recGblRecordError(S_dev_noDevice, (void*)prec,
+			"No axis with this id, or no msimEncoder()");
+		return S_dev_noDevice;
+	}
+	if(prec->inp.value.vmeio.signal<0 || prec->inp.value.vmeio.signal>=enc_nsig ||
+	   prec->ftvl!=menuFtypeDOUBLE){
+		recGblRecordError(S_db_badField, (void*)prec,
+			"Requires FTVL=DOUBLE and S0, S1, or S2");
+		return S_db_badField;
+	}
+
+	prec->dpvt=priv;
+	return 0;
+}
+
+static
+long get_ioint_info_enc(int dir, dbCommon *prec, IOSCANPVT *io)
+{
+	struct devsim *priv=prec->dpvt;
+
+	if(priv)
+		*io=priv->enc->scan;
+	return 0;
+}
+
+static
+long read_wf_enc(waveformRecord *prec)
+{
+	struct devsim *priv=prec->dpvt;
+	epicsUInt32 n;
+
+	if(!priv){
+		(void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+		return 0;
+	}
+
+	epicsMutexMustLock(priv->ctrl->lock);
+	n=priv->enc->nready;
+	if(n>prec->nelm)
+		n=prec->nelm;
+	memcpy(prec->bptr, priv->enc->ready[prec->inp.value.vmeio.signal], n*sizeof(double));
+	epicsMutexUnlock(priv->ctrl->lock);
+
+	prec->nord=n;
+	return 0;
+}
+
+struct {
+	long num;
+	DEVSUPFUN report;
+	DEVSUPFUN init;
+	DEVSUPFUN init_record;
+	DEVSUPFUN get_ioint_info;
+	DEVSUPFUN read_wf;
+} devWfMSIMEnc = {
+	5,
+	NULL,
+	NULL,
+	(DEVSUPFUN) init_record_enc,
+	(DEVSUPFUN) get_ioint_info_enc,
+	(DEVSUPFUN) read_wf_enc
+};
+epicsExportAddress(dset, devWfMSIMEnc);
+
 struct motor_dset devMSIM = {
 	{
 	 8,
-	 NULL, /* report */
-	 NULL, /* init */
+	 (DEVSUPFUN) report,
+	 (DEVSUPFUN) init,
 	 (DEVSUPFUN) init_record,
 	 NULL /* get_ioint_info */
 	},
@@ -456,13 +1114,240 @@ static const iocshArg addmsimArg0 = { "id#", iocshArgInt };
 static const iocshArg addmsimArg1 = { "Low limit", iocshArgInt };
 static const iocshArg addmsimArg2 = { "High limit", iocshArgInt };
 static const iocshArg addmsimArg3 = { "Update Rate", iocshArgDouble };
-static const iocshArg * const addmsimArgs[4] = 
-{ &addmsimArg0, &addmsimArg1, &addmsimArg2, &addmsimArg3 };
+static const iocshArg addmsimArg4 = { "Controller id#", iocshArgInt };
+static const iocshArg * const addmsimArgs[5] = 
+{ &addmsimArg0, &addmsimArg1, &addmsimArg2, &addmsimArg3, &addmsimArg4 };
 static const iocshFuncDef addmsimFuncDef =
-{ "addmsim", 4, addmsimArgs };
+{ "addmsim", 5, addmsimArgs };
 static void addmsimCallFunc(const iocshArgBuf *args)
 {
-  addmsim(args[0].ival,args[1].ival,args[2].ival,args[3].dval);
+  addmsim(args[0].ival,args[1].ival,args[2].ival,args[3].dval,args[4].ival);
+}
+
+static const iocshArg addmsimFleetArg0 = { "prefix", iocshArgString };
+static const iocshArg addmsimFleetArg1 = { "count", iocshArgInt };
+static const iocshArg addmsimFleetArg5 = { "Axes per controller", iocshArgInt };
+static const iocshArg * const addmsimFleetArgs[6] = 
+{ &addmsimFleetArg0, &addmsimFleetArg1, &addmsimArg1, &addmsimArg2, &addmsimArg3, &addmsimFleetArg5 };
+static const iocshFuncDef addmsimFleetFuncDef =
+{ "addmsimFleet", 6, addmsimFleetArgs };
+static void addmsimFleetCallFunc(const iocshArgBuf *args)
+{
+  addmsimFleet(args[0].sval,args[1].ival,args[2].ival,args[3].ival,args[4].dval,args[5].ival);
+}
+
+/* Select the simulated clock of one axis, or all axes when id<0.
+ * Must be called before iocInit.
+ */
+static
+void msimClock(int id, double scale, double step)
+{
+	ELLNODE *node;
+	struct devsim *cur;
+
+	if(interruptAccept){
+		printf("msimClock must be called before iocInit\n");
+		return;
+	}
+	if(scale<=0.0)
+		scale=1.0;
+	if(step<0.0)
+		step=0.0;
+
+	if(id<0){
+		defclock.scale=scale;
+		defclock.step=step;
+	}
+
+	for(node=ellFirst(&devices); node; node=ellNext(node))
+	{
+		cur=(struct devsim*)node;
+		if(id>=0 && cur->id!=id)
+			continue;
+		cur->clock.scale=scale;
+		cur->clock.step=step;
+	}
+}
+
+static const iocshArg msimClockArg0 = { "id# (-1 for all)", iocshArgInt };
+static const iocshArg msimClockArg1 = { "Scale", iocshArgDouble };
+static const iocshArg msimClockArg2 = { "Step (sec)", iocshArgDouble };
+static const iocshArg * const msimClockArgs[3] = 
+{ &msimClockArg0, &msimClockArg1, &msimClockArg2 };
+static const iocshFuncDef msimClockFuncDef =
+{ "msimClock", 3, msimClockArgs };
+static void msimClockCallFunc(const iocshArgBuf *args)
+{
+  msimClock(args[0].ival,args[1].dval,args[2].dval);
+}
+
+/* Select what happens to missed polls of one axis, or all axes when id<0.
+ * "catchup" runs up to 'maxlag' periods of missed polls back to back,
+ * "skip" drops them.
+ */
+static
+void msimSchedule(int id, const char *policy, double maxlag)
+{
+	ELLNODE *node;
+	struct devsim *cur;
+	int skip;
+
+	if(!policy || strcmp(policy, "catchup")==0)
+		skip=0;
+	else if(strcmp(policy, "skip")==0)
+		skip=1;
+	else {
+		printf("Usage: msimSchedule <id#> catchup|skip <max lag>\n");
+		return;
+	}
+	if(maxlag<=0.0)
+		maxlag=defsched.maxlag;
+
+	if(id<0){
+		defsched.skip=skip;
+		defsched.maxlag=maxlag;
+	}
+
+	for(node=ellFirst(&devices); node; node=ellNext(node))
+	{
+		cur=(struct devsim*)node;
+		if(id>=0 && cur->id!=id)
+			continue;
+		cur->sched.skip=skip;
+		cur->sched.maxlag=maxlag;
+	}
+}
+
+static const iocshArg msimScheduleArg0 = { "id# (-1 for all)", iocshArgInt };
+static const iocshArg msimScheduleArg1 = { "catchup|skip", iocshArgString };
+static const iocshArg msimScheduleArg2 = { "Max lag (periods)", iocshArgDouble };
+static const iocshArg * const msimScheduleArgs[3] = 
+{ &msimScheduleArg0, &msimScheduleArg1, &msimScheduleArg2 };
+static const iocshFuncDef msimScheduleFuncDef =
+{ "msimSchedule", 3, msimScheduleArgs };
+static void msimScheduleCallFunc(const iocshArgBuf *args)
+{
+  msimSchedule(args[0].ival,args[1].sval,args[2].dval);
+}
+
+/* Print a histogram of how late polls ran for one axis, or all axes
+ * when id<0.  Counts are updated by the controller thread without
+ * locking, so are approximate while running.
+ */
+static
+void msimLateness(int id, int reset)
+{
+	ELLNODE *node;
+	struct devsim *cur;
+	struct latestats st;
+	int i, last;
+
+	for(node=ellFirst(&devices); node; node=ellNext(node))
+	{
+		cur=(struct devsim*)node;
+		if(id>=0 && cur->id!=id)
+			continue;
+
+		st=cur->late;
+		printf("Axis %d: period %g sec, %s, %lu polls, %lu skipped, max late %.1f us\n",
+		       cur->id, cur->sched.period, cur->sched.skip ? "skip" : "catchup",
+		       st.polls, st.skipped, st.max*1e6);
+
+		for(last=late_nbins-1; last>0 && !st.bins[last]; last--) {}
+		for(i=0; i<=last && st.polls; i++)
+		{
+			if(i==0)
+				printf("  <1 us       %10lu\n", st.bins[i]);
+			else
+				printf("  <%-8.0f us %10lu\n", ldexp(1.0, i), st.bins[i]);
+		}
+
+		if(reset)
+			cur->lateReset=1;
+	}
+}
+
+static const iocshArg msimLatenessArg0 = { "id# (-1 for all)", iocshArgInt };
+static const iocshArg msimLatenessArg1 = { "Reset", iocshArgInt };
+static const iocshArg * const msimLatenessArgs[2] = 
+{ &msimLatenessArg0, &msimLatenessArg1 };
+static const iocshFuncDef msimLatenessFuncDef =
+{ "msimLateness", 2, msimLatenessArgs };
+static void msimLatenessCallFunc(const iocshArgBuf *args)
+{
+  msimLateness(args[0].ival,args[1].ival);
+}
+
+/* Give axis 'id' an encoder stream of 'rate' samples per simulated
+ * second.  Blocks hold up to 'nelm' samples.  Call before iocInit.
+ */
+static
+void msimEncoder(int id, double rate, int nelm)
+{
+	struct devsim *priv=getDev(id);
+	unsigned i;
+
+	if(interruptAccept){
+		printf("msimEncoder must be called before iocInit\n");
+		return;
+	}
+	if(!priv || priv->enc || rate<=0.0){
+		printf("Invalid id, or rate, or encoder already added\n");
+		return;
+	}
+	if(nelm<=0)
+		nelm=(int)ceil(2*rate/priv->rate);
+
+	priv->enc=callocMustSucceed(1, sizeof(*priv->enc), "msimEncoder");
+	priv->enc->rate=rate;
+	priv->enc->nelm=nelm;
+	for(i=0; i<enc_nsig; i++){
+		priv->enc->fill[i]=callocMustSucceed(nelm, sizeof(double), "msimEncoder");
+		priv->enc->ready[i]=callocMustSucceed(nelm, sizeof(double), "msimEncoder");
+	}
+	scanIoInit(&priv->enc->scan);
+}
+
+static const iocshArg msimEncoderArg0 = { "id#", iocshArgInt };
+static const iocshArg msimEncoderArg1 = { "Rate (samples/sec)", iocshArgDouble };
+static const iocshArg msimEncoderArg2 = { "Max samples per poll", iocshArgInt };
+static const iocshArg * const msimEncoderArgs[3] = 
+{ &msimEncoderArg0, &msimEncoderArg1, &msimEncoderArg2 };
+static const iocshFuncDef msimEncoderFuncDef =
+{ "msimEncoder", 3, msimEncoderArgs };
+static void msimEncoderCallFunc(const iocshArgBuf *args)
+{
+  msimEncoder(args[0].ival,args[1].dval,args[2].ival);
+}
+
+/* Publish the position of every axis at each poll to a new
+ * shared memory ring.
+ */
+static
+void msimShmPublish(const char *name, int capacity)
+{
+	if(!name || !*name || capacity<=0){
+		printf("Usage: msimShmPublish(\"/name\", capacity)\n");
+		return;
+	}
+	if(shmring){
+		printf("Already publishing\n");
+		return;
+	}
+	shmring=shmRingCreate(name, capacity);
+	if(!shmring)
+		printf("Failed to create shared memory ring %s\n", name);
+}
+
+static const iocshArg msimShmPublishArg0 = { "name", iocshArgString };
+static const iocshArg msimShmPublishArg1 = { "capacity", iocshArgInt };
+static const iocshArg * const msimShmPublishArgs[2] = 
+{ &msimShmPublishArg0, &msimShmPublishArg1 };
+static const iocshFuncDef msimShmPublishFuncDef =
+{ "msimShmPublish", 2, msimShmPublishArgs };
+static void msimShmPublishCallFunc(const iocshArgBuf *args)
+{
+  msimShmPublish(args[0].sval,args[1].ival);
 }
 
 static
@@ -470,5 +1355,11 @@ void msimreg(void)
 {
 	initHookRegister(&inithooks);
 	iocshRegister(&addmsimFuncDef, addmsimCallFunc);
+	iocshRegister(&addmsimFleetFuncDef, addmsimFleetCallFunc);
+	iocshRegister(&msimClockFuncDef, msimClockCallFunc);
+	iocshRegister(&msimShmPublishFuncDef, msimShmPublishCallFunc);
+	iocshRegister(&msimEncoderFuncDef, msimEncoderCallFunc);
+	iocshRegister(&msimScheduleFuncDef, msimScheduleCallFunc);
+	iocshRegister(&msimLatenessFuncDef, msimLatenessCallFunc);
 }
 epicsExportRegistrar(msimreg);
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <callback.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+/*
+ * Soak test for a fleet of simulated motors created with addmsimFleet().
+ *
+ * A background thread sends random MOVE_ABS (VAL), MOVE_REL (RLV)
+ * and STOP commands to the motor records through database puts,
+ * and watches DMOV to measure the time from command to completion.
+ * A probe callback measures the queuing delay of the priorityHigh
+ * callback thread, which runs all simulator updates.
+ */
+
+/* Per axis state */
+struct soakAxis {
+	DBADDR val, rlv, stop, dmov;
+	int busy; /* waiting for DMOV */
+	epicsTimeStamp cmdtime;
+};
+
+/* Accumulated min/mean/max */
+struct soakStat {
+	unsigned long count;
+	double sum, min, max;
+};
+
+struct soakTest {
+	struct soakAxis *axes;
+	int naxes;
+	double rate, duration, range;
+	unsigned int seed;
+
+	/* moves/stops issued, moves completed */
+	unsigned long nabs, nrel, nstop, ndone;
+	struct soakStat dmov;
+
+	/* priorityHigh queue delay from the probe callback */
+	epicsMutexId lock;
+	CALLBACK probe;
+	int probeBusy;
+	epicsTimeStamp probeTime;
+	struct soakStat queue;
+};
+
+static
+void statReset(struct soakStat *st)
+{
+	st->count=0;
+	st->sum=0.0;
+	st->min=1e300;
+	st->max=0.0;
+}
+
+static
+void statAdd(struct soakStat *st, double val)
+{
+	st->count++;
+	st->sum+=val;
+	if(val<st->min) st->min=val;
+	if(val>st->max) st->max=val;
+}
+
+static
+void statShow(const char *name, const struct soakStat *st)
+{
+	if(!st->count)
+		printf(" %s: no samples\n", name);
+	else
+		printf(" %s: min %.3f ms  mean %.3f ms  max %.3f ms  (%lu samples)\n",
+			name, st->min*1e3, st->sum/st->count*1e3, st->max*1e3, st->count);
+}
+
+static
+void probecb(CALLBACK *cb)
+{
+	struct soakTest *test;
+	epicsTimeStamp now;
+
+	callbackGetUser(test, cb);
+	epicsTimeGetCurrent(&now);
+
+	epicsMutexMustLock(test->lock);
+	statAdd(&test->queue, epicsTimeDiffInSeconds(&now, &test->probeTime));
+	test->probeBusy=0;
+	epicsMutexUnlock(test->lock);
+}
+
+static
+void soakReport(struct soakTest *test, double ellapsed, double cpu)
+{
+	printf("msimSoak: %d axes, %.1f sec\n", test->naxes, ellapsed);
+	printf(" issued: %lu abs, %lu rel, %lu stop.  completed: %lu (%.1f moves/sec)\n",
+		test->nabs, test->nrel, test->nstop, test->ndone,
+		test->ndone/ellapsed);
+	statShow("command to DMOV", &test->dmov);
+	epicsMutexMustLock(test->lock);
+	statShow("priorityHigh queue delay", &test->queue);
+	epicsMutexUnlock(test->lock);
+	printf(" CPU: %.2f %% total, %.4f %% per axis\n",
+		100.0*cpu/ellapsed, 100.0*cpu/ellapsed/test->naxes);
+}
+
+static
+void soakWorker(void *raw)
+{
+	struct soakTest *test=raw;
+	epicsTimeStamp start, now, lastprobe, lastreport;
+	clock_t cpustart=clock();
+	double ellapsed;
+
+	epicsTimeGetCurrent(&start);
+	lastprobe=lastreport=start;
+
+	do {
+		struct soakAxis *axis;
+		epicsInt16 dmov;
+		int i, cmd;
+
+		epicsTimeGetCurrent(&now);
+
+		/* look for completed moves */
+		for(i=0; i<test->naxes; i++)
+		{
+			axis=&test->axes[i];
+			if(!axis->busy)
+				continue;
+			if(dbGetField(&axis->dmov, DBR_SHORT, &dmov, NULL, NULL, NULL))
+				continue;
+			if(!dmov)
+				continue;
+			axis->busy=0;
+			test->ndone++;
+			statAdd(&test->dmov, epicsTimeDiffInSeconds(&now, &axis->cmdtime));
+		}
+
+		/* issue a random command to a random axis */
+		axis=&test->axes[rand_r(&test->seed)%test->naxes];
+		cmd=rand_r(&test->seed)%10;
+
+		if(axis->busy){
+			if(cmd<2){
+				epicsInt16 stop=1;
+				if(!dbPutField(&axis->stop, DBR_SHORT, &stop, 1))
+					test->nstop++;
+			}
+		}else if(cmd<6){
+			double val=(2.0*rand_r(&test->seed)/RAND_MAX-1.0)*test->range;
+			if(!dbPutField(&axis->val, DBR_DOUBLE, &val, 1)){
+				test->nabs++;
+				axis->busy=1;
+				axis->cmdtime=now;
+			}
+		}else{
+			double rlv=(2.0*rand_r(&test->seed)/RAND_MAX-1.0)*test->range/10.0;
+			if(!dbPutField(&axis->rlv, DBR_DOUBLE, &rlv, 1)){
+				test->nrel++;
+				axis->busy=1;
+				axis->cmdtime=now;
+			}
+		}
+
+		/* probe callback queue delay 10 times a second */
+		if(epicsTimeDiffInSeconds(&now, &lastprobe)>=0.1){
+			epicsMutexMustLock(test->lock);
+			if(!test->probeBusy){
+				test->probeBusy=1;
+				epicsTimeGetCurrent(&test->probeTime);
+				callbackRequest(&test->probe);
+			}
+			epicsMutexUnlock(test->lock);
+			lastprobe=now;
+		}
+
+		ellapsed=epicsTimeDiffInSeconds(&now, &start);
+
+		if(epicsTimeDiffInSeconds(&now, &lastreport)>=10.0){
+			soakReport(test, ellapsed, (double)(clock()-cpustart)/CLOCKS_PER_SEC);
+			lastreport=now;
+		}
+
+		epicsThreadSleep(1.0/test->rate);
+	} while(ellapsed < test->duration);
+
+	soakReport(test, ellapsed, (double)(clock()-cpustart)/CLOCKS_PER_SEC);
+
+	/* wait for any outstanding probe before freeing */
+	epicsMutexMustLock(test->lock);
+	while(test->probeBusy){
+		epicsMutexUnlock(test->lock);
+		epicsThreadSleep(0.1);
+		epicsMutexMustLock(test->lock);
+	}
+	epicsMutexUnlock(test->lock);
+
+	epicsMutexDestroy(test->lock);
+	free(test->axes);
+	free(test);
+}
+
+static
+int lookupField(const char *prefix, int i, const char *field, DBADDR *addr)
+{
+	char name[PVNAME_STRINGSZ+8];
+
+	epicsSnprintf(name, sizeof(name), "%sm%d.%s", prefix, i, field);
+	if(dbNameToAddr(name, addr)){
+		printf("No such PV %s\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+/* Start a soak test against records loaded by addmsimFleet().
+ * 'rate' is commands per second, 'range' the maximum absolute
+ * position, 'duration' in seconds.
+ */
+static
+void msimSoak(const char *prefix, int count, double rate, double range, double duration)
+{
+	struct soakTest *test;
+	int i;
+
+	if(!prefix || count<=0 || rate<=0.0 || duration<=0.0){
+		printf("Usage: msimSoak <prefix> <count> <rate> <range> <duration>\n");
+		return;
+	}
+	if(!interruptAccept){
+		printf("msimSoak must be run after iocInit\n");
+		return;
+	}
+
+	test=callocMustSucceed(1, sizeof(*test), "msimSoak");
+	test->axes=callocMustSucceed(count, sizeof(*test->axes), "msimSoak");
+
+	for(i=0; i<count; i++)
+	{
+		struct soakAxis *axis=&test->axes[i];
+		if(lookupField(prefix, i, "VAL", &axis->val) ||
+			lookupField(prefix, i, "RLV", &axis->rlv) ||
+			lookupField(prefix, i, "STOP", &axis->stop) ||
+			lookupField(prefix, i, "DMOV", &axis->dmov))
+		{
+			free(test->axes);
+			free(test);
+			return;
+		}
+	}
+
+	test->naxes=count;
+	test->rate=rate;
+	test->range=range>0.0 ? range : 100.0;
+	test->duration=duration;
+	test->seed=(unsigned int)time(NULL);
+	statReset(&test->dmov);
+	statReset(&test->queue);
+
+	test->lock=epicsMutexMustCreate();
+	callbackSetCallback(probecb, &test->probe);
+	callbackSetPriority(priorityHigh, &test->probe);
+	callbackSetUser(test, &test->probe);
+
+	epicsThreadMustCreate("msimSoak", epicsThreadPriorityLow,
+		epicsThreadGetStackSize(epicsThreadStackSmall),
+		&soakWorker, test);
+}
+
+static const iocshArg msimSoakArg0 = { "prefix", iocshArgString };
+static const iocshArg msimSoakArg1 = { "count", iocshArgInt };
+static const iocshArg msimSoakArg2 = { "commands/sec", iocshArgDouble };
+static const iocshArg msimSoakArg3 = { "range", iocshArgDouble };
+static const iocshArg msimSoakArg4 = { "duration", iocshArgDouble };
+static const iocshArg * const msimSoakArgs[5] = 
+{ &msimSoakArg0, &msimSoakArg1, &msimSoakArg2, &msimSoakArg3, &msimSoakArg4 };
+static const iocshFuncDef msimSoakFuncDef =
+{ "msimSoak", 5, msimSoakArgs };
+static void msimSoakCallFunc(const iocshArgBuf *args)
+{
+  msimSoak(args[0].sval,args[1].ival,args[2].dval,args[3].dval,args[4].dval);
+}
+
+static
+void msimSoakRegister(void)
+{
+	iocshRegister(&msimSoakFuncDef, msimSoakCallFunc);
+}
+epicsExportRegistrar(msimSoakRegister);
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recSup.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+
+#include "asyncsched.h"
+
+/* Pending operations.  Records nearly always wait for one of a few
+ * fixed delays, and operations with the same delay expire in the
+ * order they were queued.  So each delay has a FIFO, and the next
+ * operation to expire is at the head of one of them.
+ */
+struct delayQueue {
+  struct delayQueue* next;
+  double delay;
+  struct asyncOp *first, *last;
+};
+static struct delayQueue* queues;
+
+static epicsMutexId schedLock;
+static epicsEventId schedWakeup;
+static epicsTimeStamp schedEpoch;
+static epicsThreadOnceId schedOnce = EPICS_THREAD_ONCE_INIT;
+
+static double schedNow(void)
+{
+  epicsTimeStamp now;
+  epicsTimeGetCurrent(&now);
+  return epicsTimeDiffInSeconds(&now, &schedEpoch);
+}
+
+static void schedWorker(void* unused)
+{
+  while(1) {
+    struct delayQueue *q, *next = NULL;
+    struct asyncOp* op = NULL;
+    double wait = -1.0;
+
+    epicsMutexMustLock(schedLock);
+    for(q=queues; q; q=q->next) {
+      if(q->first && (!next || q->first->deadline < next->first->deadline))
+        next = q;
+    }
+    if(next) {
+      wait = next->first->deadline - schedNow();
+      if(wait<=0.0) {
+        op = next->first;
+        next->first = op->next;
+        if(!next->first)
+          next->last = NULL;
+      }
+    }
+    epicsMutexUnlock(schedLock);
+
+    if(op)
+      callbackRequest(&op->cb);
+    else if(wait<0.0)
+      epicsEventMustWait(schedWakeup);
+    else
+      (void)epicsEventWaitWithTimeout(schedWakeup, wait);
+  }
+}
+
+static void schedInit(void* unused)
+{
+  schedLock = epicsMutexMustCreate();
+  schedWakeup = epicsEventMustCreate(epicsEventEmpty);
+  epicsTimeGetCurrent(&schedEpoch);
+  epicsThreadMustCreate("asyncsched", epicsThreadPriorityHigh,
+                        epicsThreadGetStackSize(epicsThreadStackSmall),
+                        &schedWorker, NULL);
+}
+
+/* Resume a record */
+static void asyncResume(CALLBACK* cb)
+{
+  struct asyncOp* op;
+  struct rset* prset;
+
+  callbackGetUser(op, cb);
+  prset = (struct rset*)op->prec->rset;
+
+  dbScanLock(op->prec);
+  (*prset->process)(op->prec);
+  dbScanUnlock(op->prec);
+}
+
+void asyncOpInit(struct asyncOp* op, dbCommon* prec, int priority)
+{
+  epicsThreadOnce(&schedOnce, &schedInit, NULL);
+
+  op->prec = prec;
+  op->resume = 0;
+  op->next = NULL;
+  callbackSetCallback(asyncResume, &op->cb);
+  callbackSetPriority(priority, &op->cb);
+  callbackSetUser(op, &op->cb);
+}
+
+void asyncOpSchedule(struct asyncOp* op, double delay)
+{
+  struct delayQueue* q;
+  int first;
+
+  epicsMutexMustLock(schedLock);
+  for(q=queues; q && q->delay!=delay; q=q->next) {}
+  if(!q) {
+    /* the first use of this delay.  Kept for reuse. */
+    q = callocMustSucceed(1, sizeof(*q), "asyncOpSchedule");
+    q->delay = delay;
+    q->next = queues;
+    queues = q;
+  }
+
+  op->deadline = schedNow() + delay;
+  op->next = NULL;
+  if(q->last)
+    q->last->next = op;
+  else
+    q->first = op;
+  q->last = op;
+  /* later than the head of a non-empty queue, so no earlier wakeup */
+  first = q->first==op;
+  epicsMutexUnlock(schedLock);
+
+  if(first)
+    epicsEventSignal(schedWakeup);
+}
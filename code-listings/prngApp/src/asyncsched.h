@@ -0,0 +1,72 @@
+
+#ifndef ASYNCSCHED_H
+#define ASYNCSCHED_H 1
+
+#include <dbCommon.h>
+#include <callback.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous device support written as straight line code.
+ *
+ * A read function between ASYNC_BEGIN() and ASYNC_END() may
+ * wait with ASYNC_DELAY().  This sets PACT and returns.  When the
+ * delay expires the record is processed again, and the read
+ * function continues after the ASYNC_DELAY().
+ *
+ *   static long read_ai(aiRecord *prec)
+ *   {
+ *     struct priv *priv = prec->dpvt;
+ *     ASYNC_BEGIN(&priv->op);
+ *     ASYNC_DELAY(&priv->op, 0.1);
+ *     prec->rval = generate(priv);
+ *     ASYNC_END(&priv->op);
+ *     return 0;
+ *   }
+ *
+ * Local variables are not kept across ASYNC_DELAY(), and a read function
+ * may contain no other switch statement around an ASYNC_DELAY().
+ *
+ * All delays are served by one thread, instead of a timer for each
+ * record, from a FIFO for each distinct delay.  Operations are part of
+ * the record's private structure, so nothing is allocated per
+ * operation, only once for each new delay.
+ */
+
+struct asyncOp {
+  CALLBACK cb; /* processes the record on resume */
+  dbCommon *prec;
+  int resume;  /* where to continue, 0 at the start */
+  double deadline;
+  struct asyncOp *next; /* in the queue of its delay */
+};
+
+/* Prepare an operation for 'prec', which will be processed by
+ * callbacks of 'priority'.  Call from init_record().
+ */
+void asyncOpInit(struct asyncOp* op, dbCommon* prec, int priority);
+
+/* Process op->prec after 'delay' seconds */
+void asyncOpSchedule(struct asyncOp* op, double delay);
+
+#define ASYNC_BEGIN(OP) switch((OP)->resume) { case 0:
+
+#define ASYNC_DELAY(OP, DELAY) \
+  do { \
+    (OP)->resume = __LINE__; \
+    (OP)->prec->pact = TRUE; \
+    asyncOpSchedule(OP, DELAY); \
+    return 0; \
+    case __LINE__: ; \
+  } while(0)
+
+#define ASYNC_END(OP) } (OP)->resume = 0; (OP)->prec->pact = FALSE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASYNCSCHED_H */
@@ -0,0 +1,457 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dbAccess.h>
+#include <devSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <dbScan.h>
+#include <dbDefs.h>
+#include <ellLib.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsVersion.h>
+#include <initHooks.h>
+
+#include <devLib.h> /* for noDevice error code */
+
+#include <aaiRecord.h>
+#include <waveformRecord.h>
+#include <menuFtype.h>
+
+#include "drvprngdist.h"
+#include "prngengine.h"
+#include "threadplace.h"
+#include "perfcount.h"
+#include "scanprio.h"
+
+#include <epicsExport.h>
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,16,0,0)
+#  define USE_BPTR_SWAP
+#endif
+#endif
+
+/*
+ * Arrays of random numbers (FTVL=DOUBLE) in [0,1) for aai and waveform.
+ *
+ * "Random Intr" fills one array per period in a worker thread, while
+ * the record is an enabled I/O Intr record.  The worker fills 'fill'
+ * then swaps it with 'ready'.  With Base >= 3.16 an aai record then
+ * swaps 'ready' with its BPTR, so no values are copied.  Before 3.16
+ * links and CA cache the address of BPTR, so it is copied, as it
+ * always is for waveform, which owns its BPTR.
+ *
+ * "Random Distribution" fills BPTR in place when processed.  With
+ * SCAN="I/O Intr" that is at the rate given by setPrngRate().
+ */
+
+static ELLLIST allblocks = ELLLIST_INIT;
+
+struct prngBlock {
+  ELLNODE node;
+  dbCommon *prec;
+  struct prngEngine eng;
+  double period; /* sec. between arrays */
+  epicsUInt32 nelm;
+  epicsMutexId lock;
+  IOSCANPVT scan;
+  epicsThreadId generator;
+  epicsEventId wakeup; /* for a parked worker */
+
+  double *fill;  /* owned by the worker */
+  double *ready; /* latest complete array, guarded by lock */
+  int fresh;     /* 'ready' not yet read */
+};
+
+static struct perfCounter *nsamples, *nscans, *nreads;
+static struct perfCounter *ndistsamples, *ndistreads;
+
+static void start_workers(initHookState state);
+
+static long init(int phase)
+{
+  if(phase==0) {
+    initHookRegister(&start_workers);
+    nsamples=perfCounterGet("devAaiPrngIntr.samples");
+    nscans=perfCounterGet("devAaiPrngIntr.scans");
+    nreads=perfCounterGet("devAaiPrngIntr.reads");
+  }
+  return 0;
+}
+
+static long init_dist(int phase)
+{
+  if(phase==0) {
+    ndistsamples=perfCounterGet("devAaiPrngDist.samples");
+    ndistreads=perfCounterGet("devAaiPrngDist.reads");
+  }
+  return 0;
+}
+
+static long report(int level)
+{
+  perfCounterReport("devAaiPrngIntr.", level);
+  return 0;
+}
+
+static long report_dist(int level)
+{
+  perfCounterReport("devAaiPrngDist.", level);
+  return 0;
+}
+
+static void worker(void* raw);
+
+/* INP "@<seed> [period=<sec>] [engine=<name>]" */
+static struct prngBlock* init_block(dbCommon *prec, DBLINK *inp,
+                                    epicsEnum16 ftvl, epicsUInt32 nelm)
+{
+  struct prngBlock* priv;
+  const char *opts = inp->value.instio.string;
+  unsigned long start;
+  double period = 1.0;
+  char engine[16] = "rand_r";
+  int n;
+
+  if(ftvl!=menuFtypeDOUBLE) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Requires FTVL=DOUBLE");
+    return NULL;
+  }
+
+  if(sscanf(opts, "%lu%n", &start, &n)!=1) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "INP must be \"@<seed> [period=<sec>] [engine=<name>]\"");
+    return NULL;
+  }
+  opts += n;
+
+  while(1) {
+    char key[8], val[16];
+
+    while(*opts==' ')
+      opts++;
+    if(!*opts)
+      break;
+
+    if(sscanf(opts, "%7[a-z]=%15s%n", key, val, &n)!=2) {
+      recGblRecordError(S_db_badField, (void*)prec, "Invalid INP option");
+      return NULL;
+    }
+    opts += n;
+
+    if(strcmp(key, "period")==0) {
+      period = atof(val);
+    } else if(strcmp(key, "engine")==0) {
+      strcpy(engine, val);
+    } else {
+      recGblRecordError(S_db_badField, (void*)prec, "Invalid INP option");
+      return NULL;
+    }
+  }
+
+  priv=callocMustSucceed(1,sizeof(*priv),"prngarray");
+
+  if(period<=0.0 || prngEngineInit(&priv->eng, engine, start)) {
+    recGblRecordError(S_db_badField, (void*)prec, "Invalid period or engine");
+    free(priv);
+    return NULL;
+  }
+
+  priv->prec = prec;
+  priv->period = period;
+  priv->nelm = nelm;
+  priv->fill = callocMustSucceed(nelm, sizeof(double), "prngarray fill");
+  priv->ready = callocMustSucceed(nelm, sizeof(double), "prngarray ready");
+  priv->lock = epicsMutexMustCreate();
+  priv->wakeup = epicsEventMustCreate(epicsEventEmpty);
+  scanIoInit(&priv->scan);
+  ellAdd(&allblocks, &priv->node);
+
+  return priv;
+}
+
+static long init_record_aai(aaiRecord *prec)
+{
+  struct prngBlock* priv;
+
+  priv = init_block((dbCommon*)prec, &prec->inp, prec->ftvl, prec->nelm);
+  if(!priv)
+    return S_db_badField;
+
+  /* the third buffer when swapping.  Allocate it if the record hasn't yet */
+  if(!prec->bptr)
+    prec->bptr = callocMustSucceed(prec->nelm, sizeof(double), "prngarray bptr");
+
+  prec->dpvt = priv;
+  return 0;
+}
+
+static long init_record_wf(waveformRecord *prec)
+{
+  struct prngBlock* priv;
+
+  priv = init_block((dbCommon*)prec, &prec->inp, prec->ftvl, prec->nelm);
+  if(!priv)
+    return S_db_badField;
+
+  prec->dpvt = priv;
+  return 0;
+}
+
+static void start_workers(initHookState state)
+{
+  ELLNODE *cur;
+  if(state!=initHookAfterInterruptAccept)
+    return;
+  for(cur=ellFirst(&allblocks); cur; cur=ellNext(cur)) {
+    struct prngBlock *priv = CONTAINER(cur, struct prngBlock, node);
+    scanPrioWatch(priv->prec, priv->wakeup);
+    priv->generator = epicsThreadMustCreate("prngarray",
+                                            epicsThreadPriorityMedium,
+                                            epicsThreadGetStackSize(epicsThreadStackSmall),
+                                            &worker, priv);
+    threadPlaceApply(priv->generator, "prngarray");
+  }
+}
+
+static void worker(void* raw)
+{
+  struct prngBlock* priv=raw;
+  while(1) {
+    double *buf = priv->fill;
+    epicsUInt32 i;
+
+    if(!scanPrioRecordActive(priv->prec)) {
+      scanPrioPark(priv->wakeup);
+      continue;
+    }
+
+    for(i=0; i<priv->nelm; i++)
+      buf[i] = prngEngineNext(&priv->eng) * (1.0/2147483648.0);
+
+    epicsMutexMustLock(priv->lock);
+    priv->fill = priv->ready;
+    priv->ready = buf;
+    priv->fresh = 1;
+    epicsMutexUnlock(priv->lock);
+
+    scanIoRequest(priv->scan);
+    perfCounterAdd(nsamples, priv->nelm);
+    perfCounterInc(nscans);
+
+    epicsThreadSleep(priv->period);
+  }
+}
+
+static long get_ioint_info(int dir,dbCommon* prec,IOSCANPVT* io)
+{
+  struct prngBlock* priv=prec->dpvt;
+
+  if(priv) {
+    *io = priv->scan;
+    if(dir==0)
+      epicsEventSignal(priv->wakeup);
+  }
+  return 0;
+}
+
+static long read_aai(aaiRecord *prec)
+{
+  struct prngBlock* priv=prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  epicsMutexMustLock(priv->lock);
+#ifdef USE_BPTR_SWAP
+  if(priv->fresh) {
+    void *prev = prec->bptr;
+    prec->bptr = priv->ready;
+    priv->ready = prev;
+  }
+#else
+  memcpy(prec->bptr, priv->ready, priv->nelm*sizeof(double));
+#endif
+  priv->fresh = 0;
+  epicsMutexUnlock(priv->lock);
+
+  perfCounterInc(nreads);
+
+  prec->nord = priv->nelm;
+
+  return 0;
+}
+
+static long read_wf(waveformRecord *prec)
+{
+  struct prngBlock* priv=prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  epicsMutexMustLock(priv->lock);
+  memcpy(prec->bptr, priv->ready, priv->nelm*sizeof(double));
+  priv->fresh = 0;
+  epicsMutexUnlock(priv->lock);
+
+  perfCounterInc(nreads);
+
+  prec->nord = priv->nelm;
+
+  return 0;
+}
+
+/* "Random Distribution" with INP "#C<id> S0 @" */
+static long init_record_dist(dbCommon *prec, DBLINK *inp, epicsEnum16 ftvl)
+{
+  struct instancePrng* priv;
+
+  if(ftvl!=menuFtypeDOUBLE) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Requires FTVL=DOUBLE");
+    return S_db_badField;
+  }
+
+  priv=lookupPrng(inp->value.vmeio.card);
+  if(!priv){
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid device id code");
+    return S_dev_noDevice;
+  }
+
+  prec->dpvt=priv;
+
+  return 0;
+}
+
+static long init_record_aai_dist(aaiRecord *prec)
+{
+  return init_record_dist((dbCommon*)prec, &prec->inp, prec->ftvl);
+}
+
+static long init_record_wf_dist(waveformRecord *prec)
+{
+  return init_record_dist((dbCommon*)prec, &prec->inp, prec->ftvl);
+}
+
+static long get_ioint_info_dist(int dir,dbCommon* prec,IOSCANPVT* io)
+{
+  struct instancePrng* priv=prec->dpvt;
+
+  if(priv) {
+    *io = priv->scan;
+  }
+  return 0;
+}
+
+static void fill_dist(struct instancePrng* priv, double *buf, epicsUInt32 nelm)
+{
+  perfCounterAdd(ndistsamples, nelm);
+  perfCounterInc(ndistreads);
+
+  readPrngArray(priv, buf, nelm);
+}
+
+static long read_aai_dist(aaiRecord *prec)
+{
+  struct instancePrng* priv=prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  fill_dist(priv, prec->bptr, prec->nelm);
+  prec->nord = prec->nelm;
+
+  return 0;
+}
+
+static long read_wf_dist(waveformRecord *prec)
+{
+  struct instancePrng* priv=prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  fill_dist(priv, prec->bptr, prec->nelm);
+  prec->nord = prec->nelm;
+
+  return 0;
+}
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_aai;
+} devAaiPrngIntr = {
+  5, /* space for 5 functions */
+  report,
+  init,
+  init_record_aai,
+  get_ioint_info,
+  read_aai
+};
+epicsExportAddress(dset,devAaiPrngIntr);
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_wf;
+} devWfPrngIntr = {
+  5, /* space for 5 functions */
+  NULL, /* reported by devAaiPrngIntr */
+  NULL, /* workers started by devAaiPrngIntr */
+  init_record_wf,
+  get_ioint_info,
+  read_wf
+};
+epicsExportAddress(dset,devWfPrngIntr);
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_aai;
+} devAaiPrngDist = {
+  5, /* space for 5 functions */
+  report_dist,
+  init_dist,
+  init_record_aai_dist,
+  get_ioint_info_dist,
+  read_aai_dist
+};
+epicsExportAddress(dset,devAaiPrngDist);
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_wf;
+} devWfPrngDist = {
+  5, /* space for 5 functions */
+  NULL, /* reported by devAaiPrngDist */
+  NULL,
+  init_record_wf_dist,
+  get_ioint_info_dist,
+  read_wf_dist
+};
+epicsExportAddress(dset,devWfPrngDist);
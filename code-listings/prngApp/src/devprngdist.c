@@ -6,13 +6,24 @@
 #include <alarm.h>
 
 #include <aiRecord.h>
+#include <menuConvert.h>
 
 #include <devLib.h> /* for noDevice error code */
 
 #include "drvprngdist.h"
+#include "perfcount.h"
 
 #include <epicsExport.h>
 
+static struct perfCounter *nreads;
+
+static long init(int phase)
+{
+  if(phase==0)
+    nreads=perfCounterGet("devAiPrngDist.reads");
+  return 0;
+}
+
 static long init_record(aiRecord *prec)
 {
   struct instancePrng* priv;
@@ -24,6 +35,14 @@ static long init_record(aiRecord *prec)
     return S_dev_noDevice;
   }
 
+  if(prec->inp.value.vmeio.signal<0 ||
+     (unsigned)prec->inp.value.vmeio.signal>=priv->nchan){
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid channel (signal) number");
+    return S_dev_noDevice;
+  }
+
+  usePrngChannel(priv, prec->inp.value.vmeio.signal);
   prec->dpvt=priv;
 
   return 0;
@@ -32,13 +51,65 @@ static long init_record(aiRecord *prec)
 static long read_ai(aiRecord *prec)
 {
   struct instancePrng* priv=prec->dpvt;
+  unsigned chan;
+  double val;
+
   if(!priv) {
     (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
     return 0;
   }
 
-  prec->rval=priv->table->read_prng(priv->token);
+  perfCounterInc(nreads);
+
+  /* The integer read_prng() of a single channel, unless the
+   * record wants a double without conversion
+   */
+  if(priv->nchan==1 && priv->rate<=0.0 &&
+     prec->linr!=menuConvertNO_CONVERSION)
+  {
+    prec->rval=readPrngRaw(priv);
+
+    return 0;
+  }
+
+  chan=prec->inp.value.vmeio.signal;
+  val=readPrngChannel(priv, chan);
+
+  if(prec->linr!=menuConvertNO_CONVERSION) {
+    /* the record converts RVAL, by LINR or breakpoint table,
+     * so go back to the scale of read_prng()
+     */
+    prec->rval=(epicsInt32)(val/priv->scale + priv->offset);
+    return 0;
+  }
+
+  /* Already engineering units, so do the rest of the
+   * record's conversion: ROFF, ASLO and AOFF, then SMOO
+   */
+  val+=prec->roff;
+  if(prec->aslo!=0.0)
+    val*=prec->aslo;
+  val+=prec->aoff;
+  if(prec->smoo!=0.0 && !prec->init)
+    val=val*(1.0-prec->smoo) + prec->val*prec->smoo;
+  prec->val=val;
+  prec->udf=FALSE;
+  return 2; /* don't convert */
+}
+
+static long get_ioint_info(int dir,dbCommon* prec,IOSCANPVT* io)
+{
+  struct instancePrng* priv=prec->dpvt;
 
+  if(priv) {
+    *io = priv->scan;
+  }
+  return 0;
+}
+
+static long report(int level)
+{
+  perfCounterReport("devAiPrngDist.", level);
   return 0;
 }
 
@@ -52,10 +123,10 @@ struct {
   DEVSUPFUN  special_linconv;
 } devAiPrngDist = {
   6, /* space for 6 functions */
-  NULL,
-  NULL,
+  report,
+  init,
   init_record,
-  NULL,
+  get_ioint_info,
   read_ai,
   NULL
 };
@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <dbAccess.h>
 #include <devSup.h>
@@ -10,51 +12,266 @@
 #include <cantProceed.h>
 #include <epicsThread.h>
 #include <epicsMutex.h>
+#include <epicsEvent.h>
 #include <initHooks.h>
 #include <callback.h>
 #include <epicsVersion.h>
+#include <gpHash.h>
+#include <epicsStdio.h>
 
-#include <aiRecord.h>
+#include "prngintr.h"
+#include "threadplace.h"
+#include "prngstats.h"
+#include "prngengine.h"
+#include "evtrace.h"
+#include "perfcount.h"
+#include "scanprio.h"
+#include "prnggov.h"
 
 #include <epicsExport.h>
 
 static ELLLIST allprngs = ELLLIST_INIT;
 
+/* Generators by key.  Records with the same key share one generator */
+static struct gphPvt* prngtable;
+
+/* How a tier reduces 'decim' values to one */
+enum prngReduce {prngReduceLast, prngReduceMean, prngReduceMax};
+
+/* A record reading a tier */
+struct prngSub {
+  ELLNODE node;
+  dbCommon* prec;
+  const char* dev; /* for prngIntrReport() */
+};
+
+/* Records which are scanned every 'decim'th value,
+ * with the same reduction, share one scan list.
+ */
+struct prngTier {
+  ELLNODE node;
+  struct prngState* gen;
+  unsigned decim;
+  enum prngReduce reduce;
+  IOSCANPVT scan;
+  struct scanPrio prio; /* guarded by gen->lock */
+  ELLLIST subs; /* list of struct prngSub */
+
+  /* accumulated since the last scan */
+  unsigned count;
+  double sum;
+  unsigned int max;
+
+  unsigned int lastnum; /* last reduced value */
+};
+
 struct prngState {
   ELLNODE node;
-  unsigned int seed;
-  unsigned int lastnum;
+  /* "<engine> <seed> <period>".  Room for an engine[16] name, an
+   * unsigned long, and a period with 17 digits and exponent
+   */
+  char key[16+21+25];
+  struct prngEngine eng;
+  double period; /* sec. between values */
   epicsMutexId lock;
-  IOSCANPVT scan;
+  ELLLIST tiers; /* list of struct prngTier */
   epicsThreadId generator;
+  struct prngStats* stats;
+  struct prngGovClient* gov;
+
+  /* Parked while no record is active.  Signaled on a new I/O Intr
+   * record, or a change of DISA or DISV
+   */
+  epicsEventId wakeup;
+  int parked;
+  unsigned long wakeups;
+  epicsTimeStamp started;
 };
 
+static struct perfCounter *nsamples, *nscans, *nidle;
+static struct scanPrioCost dispatch;
+
 static void start_workers(initHookState state);
 
-static long init(int phase)
+void prngIntrInit(void)
 {
-  if(phase==0)
-    initHookRegister(&start_workers);
-  return 0;
+  static int done;
+
+  /* called by the init() of each dset */
+  if(done)
+    return;
+  done = 1;
+
+  initHookRegister(&start_workers);
+  nsamples=perfCounterGet("devAiPrngIntr.samples");
+  nscans=perfCounterGet("devAiPrngIntr.scans");
+  nidle=perfCounterGet("devAiPrngIntr.idle");
+  scanPrioCostInit(&dispatch, "devAiPrngIntr");
 }
 
 static void worker(void* raw);
 
-static long init_record(aiRecord *prec)
+/* Find or create the generator for an engine, seed and period */
+static struct prngState* find_generator(dbCommon *prec, const char* engine,
+                                        unsigned long seed, double period)
 {
   struct prngState* priv;
-  unsigned long start;
+  char key[sizeof(priv->key)];
+  GPHENTRY* ent;
+  int n;
 
-  priv=callocMustSucceed(1,sizeof(*priv),"prngintr");
+  /* %g is short, but rounds to 6 digits.  Periods which
+   * differ only after that must not share a generator.
+   */
+  n = epicsSnprintf(key, sizeof(key), "%s %lu ", engine, seed);
+  epicsSnprintf(key+n, sizeof(key)-n, "%g", period);
+  if(atof(key+n)!=period)
+    epicsSnprintf(key+n, sizeof(key)-n, "%.17g", period);
+
+  if(!prngtable)
+    gphInitPvt(&prngtable, 1024);
 
-  recGblInitConstantLink(&prec->inp,DBF_ULONG,&start);
+  ent = gphFind(prngtable, key, NULL);
+  if(ent)
+    return ent->userPvt;
+
+  priv=callocMustSucceed(1,sizeof(*priv),"prngintr");
 
-  priv->seed=start;
-  scanIoInit(&priv->scan);
+  strcpy(priv->key, key);
+  if(prngEngineInit(&priv->eng, engine, seed)) {
+    free(priv);
+    return NULL;
+  }
+  priv->period=period;
+  /* statistics are named for the first record using this generator */
+  priv->stats = prngStatsCreate(prec->name, 0.0, RAND_MAX+1.0);
   priv->lock = epicsMutexMustCreate();
+  priv->wakeup = epicsEventMustCreate(epicsEventEmpty);
   priv->generator = NULL;
+  priv->gov = prngGovAdd(priv->key, period>0.0 ? 1.0/period : 0.0);
   ellAdd(&allprngs, &priv->node);
-  prec->dpvt=priv;
+
+  ent = gphAdd(prngtable, priv->key, NULL);
+  ent->userPvt = priv;
+
+  return priv;
+}
+
+/* Find or add the tier of a generator, and add a record to it */
+static struct prngTier* attach_tier(struct prngState* gen, dbCommon* prec,
+                                    const char* dev, unsigned decim,
+                                    enum prngReduce reduce)
+{
+  ELLNODE *cur;
+  struct prngTier* tier;
+  struct prngSub* sub;
+
+  sub=callocMustSucceed(1,sizeof(*sub),"prngintr sub");
+  sub->prec=prec;
+  sub->dev=dev;
+
+  if(decim==1)
+    reduce = prngReduceLast; /* all the same */
+
+  for(cur=ellFirst(&gen->tiers); cur; cur=ellNext(cur)) {
+    tier = CONTAINER(cur, struct prngTier, node);
+    if(tier->decim==decim && tier->reduce==reduce) {
+      ellAdd(&tier->subs, &sub->node);
+      return tier;
+    }
+  }
+
+  tier=callocMustSucceed(1,sizeof(*tier),"prngintr tier");
+  tier->gen=gen;
+  tier->decim=decim;
+  tier->reduce=reduce;
+  scanIoInit(&tier->scan);
+  ellAdd(&tier->subs, &sub->node);
+  ellAdd(&gen->tiers, &tier->node);
+  return tier;
+}
+
+/* INP is a CONSTANT seed, or INST_IO
+ * "@<seed> [period=<sec>] [decim=<N>] [reduce=last|mean|max] [engine=<name>]"
+ */
+long prngIntrInitRecord(dbCommon *prec, DBLINK *inp, const char* dev)
+{
+  struct prngState* priv;
+  const char *opts;
+  unsigned long start;
+  double period = 1.0;
+  unsigned decim = 1;
+  enum prngReduce reduce = prngReduceLast;
+  char engine[16] = "rand_r";
+  int n;
+
+  EVTRACE_MARK("init_record", prec->name);
+
+  if(inp->type==CONSTANT) {
+    recGblInitConstantLink(inp,DBF_ULONG,&start);
+
+    priv=find_generator(prec, "rand_r", start, 1.0);
+    prec->dpvt=attach_tier(priv, prec, dev, 1, prngReduceLast);
+    return 0;
+
+  } else if(inp->type!=INST_IO) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Unsupported link type");
+    return S_db_badField;
+  }
+
+  opts = inp->value.instio.string;
+  if(sscanf(opts, "%lu%n", &start, &n)!=1) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "INP must be \"@<seed> [period=<sec>] [decim=<N>] [reduce=last|mean|max] [engine=<name>]\"");
+    return S_db_badField;
+  }
+  opts += n;
+
+  while(1) {
+    char key[8], val[16];
+
+    while(*opts==' ')
+      opts++;
+    if(!*opts)
+      break;
+
+    if(sscanf(opts, "%7[a-z]=%15s%n", key, val, &n)!=2) {
+      recGblRecordError(S_db_badField, (void*)prec, "Invalid INP option");
+      return S_db_badField;
+    }
+    opts += n;
+
+    if(strcmp(key, "period")==0) {
+      period = atof(val);
+    } else if(strcmp(key, "decim")==0) {
+      decim = strtoul(val, NULL, 10);
+    } else if(strcmp(key, "reduce")==0 && strcmp(val, "last")==0) {
+      reduce = prngReduceLast;
+    } else if(strcmp(key, "reduce")==0 && strcmp(val, "mean")==0) {
+      reduce = prngReduceMean;
+    } else if(strcmp(key, "reduce")==0 && strcmp(val, "max")==0) {
+      reduce = prngReduceMax;
+    } else if(strcmp(key, "engine")==0) {
+      strcpy(engine, val);
+    } else {
+      recGblRecordError(S_db_badField, (void*)prec, "Invalid INP option");
+      return S_db_badField;
+    }
+  }
+
+  if(period<0.0 || decim==0) {
+    recGblRecordError(S_db_badField, (void*)prec, "Invalid period or decim");
+    return S_db_badField;
+  }
+
+  priv=find_generator(prec, engine, start, period);
+  if(!priv) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Unknown engine.  Use rand_r, pcg32, xoshiro256++, or splitmix64");
+    return S_db_badField;
+  }
+  prec->dpvt=attach_tier(priv, prec, dev, decim, reduce);
 
   return 0;
 }
@@ -66,79 +283,216 @@ static void start_workers(initHookState state)
     return;
   for(cur=ellFirst(&allprngs); cur; cur=ellNext(cur)) {
     struct prngState *priv = CONTAINER(cur, struct prngState, node);
+    ELLNODE *tcur, *rec;
+
+    /* wake when a record is enabled */
+    for(tcur=ellFirst(&priv->tiers); tcur; tcur=ellNext(tcur)) {
+      struct prngTier *tier = CONTAINER(tcur, struct prngTier, node);
+      for(rec=ellFirst(&tier->subs); rec; rec=ellNext(rec))
+        scanPrioWatch(CONTAINER(rec, struct prngSub, node)->prec, priv->wakeup);
+    }
+
+    epicsTimeGetCurrent(&priv->started);
     priv->generator = epicsThreadMustCreate("prngworker",
                                             epicsThreadPriorityMedium,
                                             epicsThreadGetStackSize(epicsThreadStackSmall),
                                             &worker, priv);
+    threadPlaceApply(priv->generator, "prng");
   }
 }
 
-static void worker(void* raw)
-{
-  struct prngState* priv=raw;
-  while(1) {
-    epicsMutexMustLock(priv->lock);
-    priv->lastnum = rand_r(&priv->seed);
-    epicsMutexUnlock(priv->lock);
-
 #ifdef EPICS_VERSION_INT
 #if EPICS_VERSION_INT>=VERSION_INT(3,16,0,0)
 #  define USE_IMMEDIATE
 #endif
 #endif
 
+/* Scan the priorities in 'mask', highest first */
+static void scan_tier(struct prngTier* tier, unsigned mask)
+{
+    int prio;
+
+    if(!mask) {
+      perfCounterInc(nidle);
+      return;
+    }
+    perfCounterInc(nscans);
+
 #ifdef USE_IMMEDIATE
-    scanIoImmediate(priv->scan, priorityHigh);
-    scanIoImmediate(priv->scan, priorityMedium);
-    scanIoImmediate(priv->scan, priorityLow);
+    for(prio=NUM_CALLBACK_PRIORITIES-1; prio>=0; prio--) {
+      epicsTimeStamp start;
+      if(!(mask & (1u<<prio)))
+        continue;
+      epicsTimeGetCurrent(&start);
+      scanIoImmediate(tier->scan, prio);
+      scanPrioCostAdd(&dispatch, prio, &start);
+    }
 #else
-    scanIoRequest(priv->scan);
+    scanIoRequest(tier->scan);
+    for(prio=NUM_CALLBACK_PRIORITIES-1; prio>=0; prio--) {
+      if(mask & (1u<<prio))
+        scanPrioCostAdd(&dispatch, prio, NULL);
+    }
 #endif
+}
+
+/* Does any record want values.  Call with gen->lock held. */
+static int generator_active(struct prngState* gen)
+{
+  ELLNODE *cur, *rec;
+
+  if(gen->stats->nreaders)
+    return 1; /* statistics are kept for every value */
 
-    epicsThreadSleep(1.0);
+  for(cur=ellFirst(&gen->tiers); cur; cur=ellNext(cur)) {
+    struct prngTier *tier = CONTAINER(cur, struct prngTier, node);
+    for(rec=ellFirst(&tier->subs); rec; rec=ellNext(rec)) {
+      struct prngSub *sub = CONTAINER(rec, struct prngSub, node);
+      if(scanPrioRecordActive(sub->prec))
+        return 1;
+    }
   }
+  return 0;
 }
 
-static long get_ioint_info(int dir,dbCommon* prec,IOSCANPVT* io)
+static void worker(void* raw)
 {
-  struct prngState* priv=prec->dpvt;
+  struct prngState* priv=raw;
+  while(1) {
+    ELLNODE *cur;
+    unsigned int num;
+    epicsTimeStamp start, end;
+    int active;
+
+    priv->wakeups++;
+
+    epicsMutexMustLock(priv->lock);
+    active = generator_active(priv);
+    priv->parked = !active;
+    epicsMutexUnlock(priv->lock);
+
+    if(!active) {
+      scanPrioPark(priv->wakeup);
+      continue;
+    }
+
+    if(prngGovEnabled)
+      epicsTimeGetCurrent(&start);
+
+    EVTRACE_BEGIN("worker", priv->key);
+
+    epicsMutexMustLock(priv->lock);
+    num = prngEngineNext(&priv->eng);
+    epicsMutexUnlock(priv->lock);
+
+    prngStatsAdd(priv->stats, num);
+    perfCounterInc(nsamples);
+    prngGovCount(priv->gov, 1);
 
-  if(priv) {
-    *io = priv->scan;
+    for(cur=ellFirst(&priv->tiers); cur; cur=ellNext(cur)) {
+      struct prngTier *tier = CONTAINER(cur, struct prngTier, node);
+      int ready;
+      unsigned mask;
+
+      epicsMutexMustLock(priv->lock);
+      tier->sum += num;
+      if(tier->count==0 || num>tier->max)
+        tier->max = num;
+      ready = ++tier->count >= tier->decim;
+      if(ready) {
+        switch(tier->reduce) {
+        case prngReduceLast: tier->lastnum = num; break;
+        case prngReduceMean: tier->lastnum = (unsigned int)(tier->sum/tier->count); break;
+        case prngReduceMax:  tier->lastnum = tier->max; break;
+        }
+        tier->count = 0;
+        tier->sum = 0.0;
+      }
+      mask = tier->prio.mask;
+      epicsMutexUnlock(priv->lock);
+
+      if(ready)
+        scan_tier(tier, mask);
+    }
+
+    EVTRACE_END("worker", priv->key);
+
+    if(prngGovEnabled) {
+      epicsTimeGetCurrent(&end);
+      prngGovPace(priv->period, epicsTimeDiffInSeconds(&end, &start));
+    } else
+      epicsThreadSleep(priv->period);
   }
-  return 0;
 }
 
-static long read_ai(aiRecord *prec)
+long prngIntrGetIoint(int dir,dbCommon* prec,IOSCANPVT* io)
 {
-  struct prngState* priv=prec->dpvt;
-  if(!priv) {
-    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
-    return 0;
+  struct prngTier* tier=prec->dpvt;
+
+  if(tier) {
+    *io = tier->scan;
+    epicsMutexMustLock(tier->gen->lock);
+    scanPrioUpdate(&tier->prio, dir, prec);
+    epicsMutexUnlock(tier->gen->lock);
+    if(dir==0)
+      epicsEventSignal(tier->gen->wakeup);
   }
+  return 0;
+}
+
+unsigned int prngIntrRead(dbCommon *prec)
+{
+  struct prngTier* tier=prec->dpvt;
+  unsigned int num;
 
-  epicsMutexMustLock(priv->lock);
-  prec->rval = priv->lastnum;
-  epicsMutexUnlock(priv->lock);
+  epicsMutexMustLock(tier->gen->lock);
+  num = tier->lastnum;
+  epicsMutexUnlock(tier->gen->lock);
 
+  return num;
+}
+
+/* Does 'dev' have a record reading this generator */
+static int generator_read_by(struct prngState* gen, const char* dev)
+{
+  ELLNODE *cur, *rec;
+
+  for(cur=ellFirst(&gen->tiers); cur; cur=ellNext(cur)) {
+    struct prngTier *tier = CONTAINER(cur, struct prngTier, node);
+    for(rec=ellFirst(&tier->subs); rec; rec=ellNext(rec)) {
+      struct prngSub *sub = CONTAINER(rec, struct prngSub, node);
+      if(strcmp(sub->dev, dev)==0)
+        return 1;
+    }
+  }
   return 0;
 }
 
-struct {
-  long num;
-  DEVSUPFUN  report;
-  DEVSUPFUN  init;
-  DEVSUPFUN  init_record;
-  DEVSUPFUN  get_ioint_info;
-  DEVSUPFUN  read_ai;
-  DEVSUPFUN  special_linconv;
-} devAiPrngIntr = {
-  6, /* space for 6 functions */
-  NULL,
-  init,
-  init_record,
-  get_ioint_info,
-  read_ai,
-  NULL
-};
-epicsExportAddress(dset,devAiPrngIntr);
+/* Print generator wakeups, in total and per second since the
+ * generator started.  A generator shared by several record types
+ * is listed by each.
+ */
+void prngIntrReport(int level, const char* dev)
+{
+  ELLNODE *cur;
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent(&now);
+
+  for(cur=ellFirst(&allprngs); cur; cur=ellNext(cur)) {
+    struct prngState *priv = CONTAINER(cur, struct prngState, node);
+    unsigned long wakeups = priv->wakeups;
+    double period = 0.0;
+
+    /* tiers and subscribers only change during init_record() */
+    if(!generator_read_by(priv, dev))
+      continue;
+
+    if(priv->generator)
+      period = epicsTimeDiffInSeconds(&now, &priv->started);
+
+    printf(" %s %s wakeups=%lu (%.1f/sec)\n", priv->key,
+           priv->parked ? "parked" : "running",
+           wakeups, period>0 ? wakeups/period : 0.0);
+  }
+}
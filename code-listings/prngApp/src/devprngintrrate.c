@@ -11,12 +11,21 @@
 #include <epicsThread.h>
 #include <epicsMutex.h>
 #include <epicsEvent.h>
+#include <epicsTime.h>
 #include <initHooks.h>
 #include <callback.h>
 #include <epicsVersion.h>
 
 #include <aiRecord.h>
 
+#include "threadplace.h"
+#include "prngstats.h"
+#include "prngengine.h"
+#include "evtrace.h"
+#include "perfcount.h"
+#include "scanprio.h"
+#include "prnggov.h"
+
 #include <epicsExport.h>
 
 #ifdef EPICS_VERSION_INT
@@ -30,28 +39,79 @@
     ( (PRIORITY) = (PCALLBACK)->priority )
 #endif
 
+/* Number of values which may be in flight (queued but not
+ * yet completed) for each record.  1 gives the original
+ * stop-and-wait behavior.  Rounded up to a power of 2.
+ * Read during init_record().
+ */
+int prngIntrRateWindow = 1;
+epicsExportAddress(int, prngIntrRateWindow);
+
+/* Artificial delay in read_ai().  Set to 0 for full speed. */
+double prngIntrRateDelay = 1.0;
+epicsExportAddress(double, prngIntrRateDelay);
+
 static ELLLIST allprngs = ELLLIST_INIT;
 
+/* One generated value waiting to be read and completed */
+struct prngSlot {
+  unsigned int value;
+  unsigned waitfor; /* priorities which have not completed */
+  epicsTimeStamp queued; /* only while prngGovEnabled */
+};
+
 struct prngState {
   ELLNODE node;
-  unsigned int seed;
-  unsigned int lastnum;
+  aiRecord *prec;
+  struct prngEngine eng;
   epicsMutexId lock;
   epicsEventId nextnum;
   IOSCANPVT scan;
+  struct scanPrio prio; /* guarded by lock */
   epicsThreadId generator;
-  unsigned waitfor;
+  struct prngStats* stats;
+  struct prngGovClient* gov;
+
+  /* Ring of in-flight values indexed by sequence number.
+   * Sequence numbers in [tail, head) are in flight.
+   * 'nextread' is the next value the record will read.
+   * The number of credits available is window-(head-tail).
+   */
+  struct prngSlot *ring;
+  unsigned window;
+  unsigned long head, tail, nextread;
+  unsigned int lastnum;
+  /* ring[head] holds a value which no record has been scanned for */
+  int unsent;
+
+  /* throughput since the worker started */
+  unsigned long ncomplete;
+  epicsTimeStamp started;
+
+  /* Parked while the record is not active.  Woken with 'nextnum' */
+  int parked;
+  unsigned long wakeups;
+
 #ifndef USE_COMPLETE
   CALLBACK done[NUM_CALLBACK_PRIORITIES];
 #endif
 };
 
+static struct perfCounter *nsamples, *nscans, *ncallbacks, *nreads;
+static struct scanPrioCost dispatch;
+
 static void start_workers(initHookState state);
 
 static long init(int phase)
 {
-  if(phase==0)
+  if(phase==0) {
     initHookRegister(&start_workers);
+    nsamples=perfCounterGet("devAiPrngIntrRate.samples");
+    nscans=perfCounterGet("devAiPrngIntrRate.scans");
+    ncallbacks=perfCounterGet("devAiPrngIntrRate.callbacks");
+    nreads=perfCounterGet("devAiPrngIntrRate.reads");
+    scanPrioCostInit(&dispatch, "devAiPrngIntrRate");
+  }
   return 0;
 }
 
@@ -68,17 +128,28 @@ void prioComplete(CALLBACK*);
 static long init_record(aiRecord *prec)
 {
   struct prngState* priv;
-  unsigned long start;
+  struct prngEngine eng;
+  long status;
 
-  priv=callocMustSucceed(1,sizeof(*priv),"prngintrrate");
+  EVTRACE_MARK("init_record", prec->name);
 
-  recGblInitConstantLink(&prec->inp,DBF_ULONG,&start);
+  status=prngEngineInitLink(&eng,(dbCommon*)prec,&prec->inp);
+  if(status)
+    return status;
+
+  priv=callocMustSucceed(1,sizeof(*priv),"prngintrrate");
 
-  priv->seed=start;
+  /* round up to a power of 2 so sequence numbers wrap cleanly */
+  for(priv->window=1; (int)priv->window<prngIntrRateWindow; priv->window<<=1) {}
+  priv->ring = callocMustSucceed(priv->window, sizeof(*priv->ring), "prngintrrate ring");
+  priv->prec = prec;
+  priv->eng=eng;
+  priv->stats = prngStatsCreate(prec->name, 0.0, RAND_MAX+1.0);
   scanIoInit(&priv->scan);
   priv->lock = epicsMutexMustCreate();
   priv->nextnum = epicsEventMustCreate(epicsEventEmpty);
   priv->generator = NULL;
+  priv->gov = prngGovAdd(prec->name, 0.0);
   ellAdd(&allprngs, &priv->node);
   prec->dpvt=priv;
 
@@ -105,10 +176,13 @@ static void start_workers(initHookState state)
     return;
   for(cur=ellFirst(&allprngs); cur; cur=ellNext(cur)) {
     struct prngState *priv = CONTAINER(cur, struct prngState, node);
+    scanPrioWatch((dbCommon*)priv->prec, priv->nextnum);
+    epicsTimeGetCurrent(&priv->started);
     priv->generator = epicsThreadMustCreate("prngintrrate",
                                             epicsThreadPriorityMedium,
                                             epicsThreadGetStackSize(epicsThreadStackSmall),
                                             &worker, priv);
+    threadPlaceApply(priv->generator, "prng");
   }
 }
 
@@ -117,20 +191,46 @@ static
 void prioComplete(void *usr, IOSCANPVT scan, int prio)
 {
     int dowake;
+    unsigned long seq;
     struct prngState* priv=usr;
 #else
 static
 void prioComplete(CALLBACK* pcb)
 {
     int dowake, prio;
+    unsigned long seq;
     struct prngState* priv;
     callbackGetUser(priv, pcb);
     callbackGetPriority(prio, pcb);
 #endif /* USE_COMPLETE */
 
+    EVTRACE_MARK("prioComplete", priv->prec->name);
+    perfCounterInc(ncallbacks);
+
     epicsMutexMustLock(priv->lock);
-    priv->waitfor &= ~(1<<prio);
-    dowake = (priv->waitfor==0);
+    /* completions for one priority arrive in the order queued,
+     * so this belongs to the oldest value still waiting on 'prio'
+     */
+    for(seq=priv->tail; seq!=priv->head; seq++) {
+        struct prngSlot *slot = &priv->ring[seq&(priv->window-1)];
+        if(slot->waitfor & (1<<prio)) {
+            slot->waitfor &= ~(1<<prio);
+            break;
+        }
+    }
+    /* return credits for fully completed values, in order */
+    dowake = 0;
+    while(priv->tail!=priv->head && priv->ring[priv->tail&(priv->window-1)].waitfor==0) {
+        if(prngGovEnabled) {
+            epicsTimeStamp now;
+            epicsTimeGetCurrent(&now);
+            prngGovLatency(epicsTimeDiffInSeconds(&now,
+                           &priv->ring[priv->tail&(priv->window-1)].queued));
+        }
+        priv->tail++;
+        priv->ncomplete++;
+        dowake = 1;
+    }
     epicsMutexUnlock(priv->lock);
     if(dowake)
         epicsEventSignal(priv->nextnum);
@@ -139,35 +239,92 @@ void prioComplete(CALLBACK* pcb)
 static void worker(void* raw)
 {
   struct prngState* priv=raw;
+
   while(1) {
     unsigned needwait;
-    printf("Rate limited worker running %p\n", priv);
+    epicsTimeStamp start, end;
+
+    priv->wakeups++;
+
+    /* values are only drawn for records, so statistics readers
+     * don't keep this worker running
+     */
+    priv->parked = !scanPrioRecordActive((dbCommon*)priv->prec);
+    if(priv->parked) {
+      scanPrioPark(priv->nextnum);
+      continue;
+    }
+
+    epicsTimeGetCurrent(&start);
+
+    EVTRACE_BEGIN("worker", priv->prec->name);
+    if(prngIntrRateDelay>0)
+        EVTRACE_MARK("rate limited", priv->prec->name);
 
     epicsMutexMustLock(priv->lock);
-    assert(priv->waitfor==0);
 
-    priv->lastnum = rand_r(&priv->seed);
+    /* queue new values until out of credits.  Draw only
+     * while there are I/O Intr records to receive them.
+     */
+    while(priv->prio.mask && priv->head - priv->tail < priv->window) {
+        struct prngSlot *slot = &priv->ring[priv->head&(priv->window-1)];
+        int prio;
+
+        if(!priv->unsent)
+            slot->value = prngEngineNext(&priv->eng);
+        priv->unsent = 0;
+        if(prngGovEnabled)
+            slot->queued = start;
 
 #ifdef USE_COMPLETE
-    priv->waitfor |= scanIoRequest(priv->scan);
+        /* returns the priorities which were queued */
+        slot->waitfor = scanIoRequest(priv->scan);
 #else
-    scanIoRequest(priv->scan);
-    {
-        unsigned i;
-        for(i=0; i<NUM_CALLBACK_PRIORITIES; i++)
-            callbackRequest(&priv->done[i]);
-    }
-    priv->waitfor |= (1<<NUM_CALLBACK_PRIORITIES)-1;
+        /* queue, and wait for, only the priorities with records */
+        slot->waitfor = priv->prio.mask;
+        if(slot->waitfor) {
+            scanIoRequest(priv->scan);
+            for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++) {
+                if(slot->waitfor & (1u<<prio))
+                    callbackRequest(&priv->done[prio]);
+            }
+        }
 #endif
-    needwait = priv->waitfor!=0;
-    
+        if(slot->waitfor==0) {
+            /* A record is between get_ioint_info() and the scan list.
+             * Keep this value for the next try.
+             */
+            priv->unsent = 1;
+            break;
+        }
+        priv->head++;
+        prngStatsAdd(priv->stats, slot->value);
+        perfCounterInc(nscans);
+        perfCounterInc(nsamples);
+
+        for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++) {
+            if(slot->waitfor & (1u<<prio))
+                scanPrioCostAdd(&dispatch, prio, NULL);
+        }
+        prngGovCount(priv->gov, 1);
+    }
+    needwait = priv->head!=priv->tail;
+
     epicsMutexUnlock(priv->lock);
 
+    EVTRACE_END("worker", priv->prec->name);
+
     if(needwait) {
         epicsEventMustWait(priv->nextnum);
+        /* stretch the cycle when the governor has scaled down */
+        epicsTimeGetCurrent(&end);
+        prngGovPace(0.0, epicsTimeDiffInSeconds(&end, &start));
+    } else if(priv->unsent) {
+        /* a record is being added, try again shortly */
+        (void)epicsEventWaitWithTimeout(priv->nextnum, 0.01);
     } else {
-        /* No I/O Intr records to wait for, slow down arbitraily */
-        epicsThreadSleep(1.0);
+        /* No I/O Intr records to wait for */
+        scanPrioPark(priv->nextnum);
     }
   }
 }
@@ -177,6 +334,11 @@ static long get_ioint_info(int dir,dbCommon* prec,IOSCANPVT* io)
   struct prngState* priv=prec->dpvt;
   if(priv) {
     *io = priv->scan;
+    epicsMutexMustLock(priv->lock);
+    scanPrioUpdate(&priv->prio, dir, prec);
+    epicsMutexUnlock(priv->lock);
+    if(dir==0)
+      epicsEventSignal(priv->nextnum);
   }
   return 0;
 }
@@ -189,18 +351,65 @@ static long read_ai(aiRecord *prec)
     return 0;
   }
 
+  EVTRACE_MARK("read_ai", prec->name);
+
   epicsMutexMustLock(priv->lock);
+  /* Take the next value in sequence.  If processed for
+   * some other reason when nothing new is queued,
+   * repeat the last value.
+   */
+  if(priv->nextread - priv->tail > priv->head - priv->tail)
+    priv->nextread = priv->tail; /* fell behind */
+  if(priv->nextread!=priv->head)
+    priv->lastnum = priv->ring[(priv->nextread++)&(priv->window-1)].value;
   prec->rval = priv->lastnum;
   epicsMutexUnlock(priv->lock);
 
+  perfCounterInc(nreads);
+
   /* arbitraily slow things down.
-   * Remove this for full speed (and log spam)
+   * Set prngIntrRateDelay=0 for full speed
    */
-  epicsThreadSleep(1.0);
+  if(prngIntrRateDelay>0)
+    epicsThreadSleep(prngIntrRateDelay);
 
   return 0;
 }
 
+/* Print totals, and achieved throughput since the worker started.
+ * Changes nothing, so repeated reports agree.
+ */
+static long report(int level)
+{
+  ELLNODE *cur;
+  epicsTimeStamp now;
+
+  epicsTimeGetCurrent(&now);
+
+  for(cur=ellFirst(&allprngs); cur; cur=ellNext(cur)) {
+    struct prngState *priv = CONTAINER(cur, struct prngState, node);
+    unsigned long ndone, inflight, wakeups;
+    double period = 0.0;
+
+    epicsMutexMustLock(priv->lock);
+    ndone = priv->ncomplete;
+    inflight = priv->head - priv->tail;
+    if(priv->generator)
+      period = epicsTimeDiffInSeconds(&now, &priv->started);
+    wakeups = priv->wakeups;
+    epicsMutexUnlock(priv->lock);
+
+    printf(" %s window=%u inflight=%lu completed=%lu rate=%.1f values/sec"
+           " %s wakeups=%.1f/sec\n",
+           priv->prec->name, priv->window, inflight, ndone,
+           period>0 ? ndone/period : 0.0,
+           priv->parked ? "parked" : "running",
+           period>0 ? wakeups/period : 0.0);
+  }
+  perfCounterReport("devAiPrngIntrRate.", level);
+  return 0;
+}
+
 struct {
   long num;
   DEVSUPFUN  report;
@@ -211,7 +420,7 @@ struct {
   DEVSUPFUN  special_linconv;
 } devAiPrngIntrRate = {
   6, /* space for 6 functions */
-  NULL,
+  report,
   init,
   init_record,
   get_ioint_info,
@@ -219,3 +428,23 @@ struct {
   NULL
 };
 epicsExportAddress(dset,devAiPrngIntrRate);
+
+/* INP "@<seed> [engine=<name>]" */
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_ai;
+  DEVSUPFUN  special_linconv;
+} devAiPrngIntrRateEngine = {
+  6, /* space for 6 functions */
+  NULL, /* devAiPrngIntrRate reports all records */
+  NULL, /* workers started by devAiPrngIntrRate */
+  init_record,
+  get_ioint_info,
+  read_ai,
+  NULL
+};
+epicsExportAddress(dset,devAiPrngIntrRateEngine);
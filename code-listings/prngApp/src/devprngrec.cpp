@@ -0,0 +1,332 @@
+#include <stdlib.h>
+
+#include <dbAccess.h>
+#include <devSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <dbScan.h>
+#include <callback.h>
+#include <cantProceed.h>
+#include <epicsStdio.h>
+#include <epicsVersion.h>
+
+#include <aiRecord.h>
+#include <longinRecord.h>
+#include <mbbiRecord.h>
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,16,1,0)
+#  define USE_INT64
+#  include <int64inRecord.h>
+#endif
+#endif
+
+#include "prngengine.h"
+#include "prngintr.h"
+#include "asyncsched.h"
+#include "evtrace.h"
+#include "perfcount.h"
+
+#include <epicsExport.h>
+
+/*
+ * "Random", "Random Async" and "Random Intr" device support for
+ * longin, mbbi, and int64in (Base >= 3.16.1), from one template.
+ * For ai, "Random" and "Random Async" are the tutorial listings
+ * devprng.c and devprngasync.c, left as the text describes them.
+ * The template gives ai "Random Engine", "Random Intr", and
+ * "Random Async Sched", which is "Random Async" on the shared
+ * delay queue.
+ *
+ * prngRecord<> says how a record type stores a value in its native
+ * field.  ai stores RVAL, and the record converts as before.  longin
+ * and int64in store VAL directly, and mbbi stores RVAL under MASK.
+ *
+ * The delivery modes say where values come from:
+ *   prngSync  - a generator per record, run when processed.
+ *   prngAsync - the same, after a 0.1 sec delay (asyncsched.h).
+ *   prngIntr  - a shared generator thread (devprngintr.c).
+ *
+ * prngDev<Record, Mode> has the dset functions.  Counters are named
+ * "<prefix><mode>.<event>", like "devLiPrngIntr.reads".
+ */
+
+/* Record types */
+
+template<typename Rec> struct prngRecord;
+
+template<> struct prngRecord<aiRecord> {
+  enum {nfuncs=6};
+  static const char* prefix() { return "devAi"; }
+  static DBLINK* inp(aiRecord* prec) { return &prec->inp; }
+  static void store(aiRecord* prec, unsigned int v) { prec->rval = v; }
+};
+
+template<> struct prngRecord<longinRecord> {
+  enum {nfuncs=5};
+  static const char* prefix() { return "devLi"; }
+  static DBLINK* inp(longinRecord* prec) { return &prec->inp; }
+  static void store(longinRecord* prec, unsigned int v) {
+    prec->val = (epicsInt32)v;
+    prec->udf = 0;
+  }
+};
+
+template<> struct prngRecord<mbbiRecord> {
+  enum {nfuncs=5};
+  static const char* prefix() { return "devMbbi"; }
+  static DBLINK* inp(mbbiRecord* prec) { return &prec->inp; }
+  static void store(mbbiRecord* prec, unsigned int v) {
+    prec->rval = prec->mask ? (v & prec->mask) : v;
+  }
+};
+
+#ifdef USE_INT64
+template<> struct prngRecord<int64inRecord> {
+  enum {nfuncs=5};
+  static const char* prefix() { return "devI64in"; }
+  static DBLINK* inp(int64inRecord* prec) { return &prec->inp; }
+  static void store(int64inRecord* prec, unsigned int v) {
+    prec->val = (epicsInt64)v;
+    prec->udf = 0;
+  }
+};
+#endif
+
+/* Delivery modes */
+
+struct prngSync {
+  static const char* name() { return "Prng"; }
+};
+
+struct prngAsync {
+  static const char* name() { return "PrngAsync"; }
+};
+
+struct prngIntr {
+  static const char* name() { return "PrngIntr"; }
+};
+
+/* Counters of one record type and mode */
+struct prngCounters {
+  struct perfCounter *nreads, *ncallbacks;
+  char prefix[32]; /* "<prefix><mode>." */
+
+  void init(const char* rec, const char* mode, bool async) {
+    char name[48];
+    epicsSnprintf(prefix, sizeof(prefix), "%s%s.", rec, mode);
+    epicsSnprintf(name, sizeof(name), "%sreads", prefix);
+    nreads = perfCounterGet(name);
+    if(async) {
+      epicsSnprintf(name, sizeof(name), "%scallbacks", prefix);
+      ncallbacks = perfCounterGet(name);
+    }
+  }
+};
+
+template<typename Rec, typename Mode> struct prngDev;
+
+template<typename Rec> struct prngDev<Rec, prngSync> {
+  struct pvt {
+    struct prngEngine eng;
+  };
+  static prngCounters cnt;
+
+  static long init(int phase) {
+    if(phase==0)
+      cnt.init(prngRecord<Rec>::prefix(), prngSync::name(), false);
+    return 0;
+  }
+  static long report(int level) {
+    perfCounterReport(cnt.prefix, level);
+    return 0;
+  }
+  static long init_record(Rec* prec) {
+    pvt* priv = (pvt*)callocMustSucceed(1, sizeof(pvt), "prngrec");
+    long status;
+
+    EVTRACE_MARK("init_record", prec->name);
+
+    status = prngEngineInitLink(&priv->eng, (dbCommon*)prec, prngRecord<Rec>::inp(prec));
+    if(status) {
+      free(priv);
+      return status;
+    }
+    prec->dpvt = priv;
+    return 0;
+  }
+  static long read(Rec* prec) {
+    pvt* priv = (pvt*)prec->dpvt;
+    if(!priv) {
+      (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+      return 0;
+    }
+
+    EVTRACE_MARK("read", prec->name);
+
+    prngRecord<Rec>::store(prec, prngEngineNext(&priv->eng));
+    perfCounterInc(cnt.nreads);
+    return 0;
+  }
+};
+
+template<typename Rec> struct prngDev<Rec, prngAsync> {
+  struct pvt {
+    struct prngEngine eng;
+    struct asyncOp op;
+  };
+  static prngCounters cnt;
+
+  static long init(int phase) {
+    if(phase==0)
+      cnt.init(prngRecord<Rec>::prefix(), prngAsync::name(), true);
+    return 0;
+  }
+  static long report(int level) {
+    perfCounterReport(cnt.prefix, level);
+    return 0;
+  }
+  static long init_record(Rec* prec) {
+    pvt* priv = (pvt*)callocMustSucceed(1, sizeof(pvt), "prngrec");
+    long status;
+
+    status = prngEngineInitLink(&priv->eng, (dbCommon*)prec, prngRecord<Rec>::inp(prec));
+    if(status) {
+      free(priv);
+      return status;
+    }
+    asyncOpInit(&priv->op, (dbCommon*)prec, priorityLow);
+    prec->dpvt = priv;
+    return 0;
+  }
+  static long read(Rec* prec) {
+    pvt* priv = (pvt*)prec->dpvt;
+    if(!priv) {
+      (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+      return 0;
+    }
+
+    ASYNC_BEGIN(&priv->op);
+
+    ASYNC_DELAY(&priv->op, 0.1);
+    /* resumed in a callback */
+    perfCounterInc(cnt.ncallbacks);
+
+    prngRecord<Rec>::store(prec, prngEngineNext(&priv->eng));
+    perfCounterInc(cnt.nreads);
+
+    ASYNC_END(&priv->op);
+    return 0;
+  }
+};
+
+template<typename Rec> struct prngDev<Rec, prngIntr> {
+  static prngCounters cnt;
+
+  static long init(int phase) {
+    if(phase==0) {
+      prngIntrInit();
+      cnt.init(prngRecord<Rec>::prefix(), prngIntr::name(), false);
+    }
+    return 0;
+  }
+  static long report(int level) {
+    /* generators read by this record type */
+    prngIntrReport(level, prngRecord<Rec>::prefix());
+    perfCounterReport(cnt.prefix, level);
+    return 0;
+  }
+  static long init_record(Rec* prec) {
+    return prngIntrInitRecord((dbCommon*)prec, prngRecord<Rec>::inp(prec),
+                              prngRecord<Rec>::prefix());
+  }
+  static long read(Rec* prec) {
+    if(!prec->dpvt) {
+      (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+      return 0;
+    }
+
+    EVTRACE_MARK("read", prec->name);
+
+    prngRecord<Rec>::store(prec, prngIntrRead((dbCommon*)prec));
+    perfCounterInc(cnt.nreads);
+    return 0;
+  }
+};
+
+template<typename Rec> prngCounters prngDev<Rec, prngSync>::cnt;
+template<typename Rec> prngCounters prngDev<Rec, prngAsync>::cnt;
+template<typename Rec> prngCounters prngDev<Rec, prngIntr>::cnt;
+
+/* All of the input record dsets have the same layout.  ai has a
+ * sixth function, special_linconv, which these don't need.
+ */
+struct prngDset {
+  long num;
+  DEVSUPFUN report;
+  DEVSUPFUN init;
+  DEVSUPFUN init_record;
+  DEVSUPFUN get_ioint_info;
+  DEVSUPFUN read;
+  DEVSUPFUN special_linconv;
+};
+
+#define PRNG_DEV(REC, MODE) prngDev<REC##Record, MODE>
+
+/* void(*)(void) converts to and from any function type */
+#define PRNG_FUN(F) ((DEVSUPFUN)(void(*)(void))(F))
+
+/* The dset for one record type and mode */
+#define PRNG_DSET(NAME, REC, MODE, IOINT) \
+  prngDset NAME = { \
+    prngRecord<REC##Record>::nfuncs, \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::report), \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::init), \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::init_record), \
+    PRNG_FUN(IOINT), \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::read), \
+    NULL \
+  }; \
+  epicsExportAddress(dset, NAME)
+
+/* INST_IO aliases.  Reported and initialized by the dset they alias. */
+#define PRNG_DSET_ALIAS(NAME, REC, MODE, IOINT) \
+  prngDset NAME = { \
+    prngRecord<REC##Record>::nfuncs, \
+    NULL, \
+    NULL, \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::init_record), \
+    PRNG_FUN(IOINT), \
+    PRNG_FUN(&PRNG_DEV(REC, MODE)::read), \
+    NULL \
+  }; \
+  epicsExportAddress(dset, NAME)
+
+/* "Random Intr", and the INST_IO "Random Intr Decim" */
+#define PRNG_DSETS_INTR(DEV, REC) \
+  PRNG_DSET(DEV##PrngIntr, REC, prngIntr, &prngIntrGetIoint); \
+  PRNG_DSET_ALIAS(DEV##PrngIntrDecim, REC, prngIntr, &prngIntrGetIoint)
+
+/* "Random", "Random Async", and the INST_IO "Random Engine",
+ * "Random Async Engine", plus PRNG_DSETS_INTR
+ */
+#define PRNG_DSETS(DEV, REC) \
+  PRNG_DSET(DEV##Prng, REC, prngSync, NULL); \
+  PRNG_DSET_ALIAS(DEV##PrngEngine, REC, prngSync, NULL); \
+  PRNG_DSET(DEV##PrngAsync, REC, prngAsync, NULL); \
+  PRNG_DSET_ALIAS(DEV##PrngAsyncEngine, REC, prngAsync, NULL); \
+  PRNG_DSETS_INTR(DEV, REC)
+
+extern "C" {
+
+PRNG_DSET(devAiPrngEngine, ai, prngSync, NULL);
+PRNG_DSET(devAiPrngAsyncSched, ai, prngAsync, NULL);
+PRNG_DSET_ALIAS(devAiPrngAsyncEngine, ai, prngAsync, NULL);
+PRNG_DSETS_INTR(devAi, ai);
+PRNG_DSETS(devLi, longin);
+PRNG_DSETS(devMbbi, mbbi);
+#ifdef USE_INT64
+PRNG_DSETS(devI64in, int64in);
+#endif
+
+}
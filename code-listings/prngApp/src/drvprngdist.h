@@ -4,6 +4,9 @@
 
 #include <ellLib.h>
 #include <drvSup.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <dbScan.h>
 
 /*
  * Define the Driver Support interface.
@@ -18,10 +21,25 @@ typedef void* (*create_prng_fun)(unsigned int seed);
  */
 typedef int (*read_prng_fun)(void* tok);
 
+/* Read a random number already in engineering units, built
+ * from 53 bits: [0,1) for Uniform, mean 0 and sigma 1 for Gaussian.
+ */
+typedef double (*read_prng_double_fun)(void* tok);
+
+/* Fill 'out' with the next 'n' values read_prng_double() would return
+ */
+typedef void (*read_prng_block_fun)(void* tok, double* out, unsigned n);
+
 struct drvPrngDist {
   drvet base;
   create_prng_fun create_prng;
   read_prng_fun read_prng;
+  read_prng_double_fun read_prng_double; /* optional, may be NULL */
+  read_prng_block_fun read_prng_block;   /* optional, may be NULL */
+  /* read_prng() on the scale of read_prng_double() is
+   * (raw-raw_offset)*raw_scale.  Left 0, raw_scale is 1/(RAND_MAX+1).
+   */
+  double raw_offset, raw_scale;
 };
 
 /* Everything about an instance of a PRNG
@@ -31,6 +49,30 @@ struct instancePrng {
   struct drvPrngDist* table;
   void* token;
   int id;
+  struct prngStats* stats;
+  double offset, scale; /* raw_offset and raw_scale of the driver */
+
+  /* Channels, selected by the signal number "#C<id> S<chan> @".
+   * All channels are generated together in 'block'.
+   * A new block is generated when a channel is read again after
+   * every channel with a record has been read.  Until then, the
+   * channel reads the same value.
+   */
+  unsigned nchan;
+  double corr; /* correlation between channels */
+  epicsMutexId lock; /* guards block, taken, used and the counts */
+  double* block;
+  char* taken; /* channel read from this block */
+  char* used; /* channel has a record */
+  unsigned ntaken, nused; /* channels with a record taken, and used */
+
+  /* When rate>0, blocks are generated 'rate' times a second by a
+   * producer thread shared by all instances, and 'scan' is requested.
+   * Records then read the latest block.
+   */
+  double rate;
+  epicsTimeStamp next; /* next block, owned by the producer */
+  IOSCANPVT scan;
 };
 
 /* Find the PRNG instance which has been associated
@@ -38,4 +80,21 @@ struct instancePrng {
  */
 struct instancePrng* lookupPrng(short N);
 
+/* Every sample the functions below generate is added to the instance
+ * statistics, and to the shared memory ring if prngShmPublish() was called.
+ * Doubles are on the scale of read_prng_double().
+ */
+
+/* Note that a record reads channel 'chan'.  Called by init_record */
+void usePrngChannel(struct instancePrng* inst, unsigned chan);
+
+/* Read one channel of an instance, as a double */
+double readPrngChannel(struct instancePrng* inst, unsigned chan);
+
+/* Read an integer sample of a single channel instance with read_prng() */
+int readPrngRaw(struct instancePrng* inst);
+
+/* Fill 'out' with 'n' samples of channel 0, for arrays */
+void readPrngArray(struct instancePrng* inst, double* out, unsigned n);
+
 #endif /* DRVPRNGDIST_H */
@@ -6,6 +6,11 @@
 
 #include <epicsExport.h>
 
+/* Each sample is the mean of this many uniform values */
+#define NTERMS 8
+/* sqrt(12/NTERMS), 1/sigma of a sum of NTERMS values in [0,1) */
+#define NORM 1.2247448713915890
+
 struct gaussian {
   unsigned int state;
 };
@@ -35,6 +40,29 @@ int read(void* tok)
   return ret;
 }
 
+static
+double read_double(void* tok)
+{
+  struct gaussian* priv=tok;
+  double ret=0.0;
+  int i=NTERMS;
+
+  while(i--)
+    ret+=rand_r(&priv->state);
+
+  return (ret/(RAND_MAX+1.0) - NTERMS/2.0)*NORM;
+}
+
+/* The same stream as read_double(), from the same state */
+static
+void read_block(void* tok, double* out, unsigned n)
+{
+  unsigned i;
+
+  for(i=0; i<n; i++)
+    out[i]=read_double(tok);
+}
+
 static
 struct drvPrngDist drvPrngGaussian = {
   { 4,
@@ -43,5 +71,9 @@ struct drvPrngDist drvPrngGaussian = {
   },
   create,
   read,
+  read_double,
+  read_block,
+  /* read() is the mean of NTERMS values in [0,RAND_MAX] */
+  RAND_MAX/2.0, NORM*NTERMS/(RAND_MAX+1.0),
 };
 epicsExportAddress(drvet,drvPrngGaussian);
@@ -31,6 +31,26 @@ int read(void* tok)
   return rand_r(&priv->state);
 }
 
+static
+double read_double(void* tok)
+{
+  struct uniform* priv=tok;
+  int hi=rand_r(&priv->state);
+  int lo=rand_r(&priv->state);
+
+  /* 31+22 bits fill the mantissa, then scale by 2^-53 to [0,1) */
+  return (hi*4194304.0 + (lo>>9)) * (1.0/9007199254740992.0);
+}
+
+static
+void read_block(void* tok, double* out, unsigned n)
+{
+  unsigned i;
+
+  for(i=0; i<n; i++)
+    out[i]=read_double(tok);
+}
+
 static
 struct drvPrngDist drvPrngUniform = {
   { 4,
@@ -39,5 +59,8 @@ struct drvPrngDist drvPrngUniform = {
   },
   create,
   read,
+  read_double,
+  read_block,
+  0.0, 1.0/(RAND_MAX+1.0),
 };
 epicsExportAddress(drvet,drvPrngUniform);
@@ -1,12 +1,23 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <math.h>
 
 #include <errlog.h>
 #include <iocsh.h>
 #include <registryDriverSupport.h>
 #include <ellLib.h>
+#include <cantProceed.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <initHooks.h>
+#include <dbAccess.h>
+#include <dbScan.h>
 
 #include "drvprngdist.h"
+#include "prngstats.h"
+#include "shmring.h"
 
 #include <epicsExport.h>
 
@@ -14,11 +25,22 @@ static ELLLIST devices={{NULL,NULL},0};
 
 static const char dpref[]="drvPrng";
 
+/* Samples of all instances are published here */
+static struct shmRing* shmring;
+
+/* The producer thread, started for the first instance with a rate */
+static epicsEventId producerWake;
+static epicsThreadOnceId producerOnce = EPICS_THREAD_ONCE_INIT;
+
+/* 'nchan' channels (default 1), with correlation 'corr' between channels.
+ * Correlation is only allowed for "Gaussian".
+ */
 void
-createPrng(int id,int seed,const char* dist)
+createPrng(int id,int seed,const char* dist,int nchan,double corr)
 {
   unsigned int s=(unsigned int)seed;
   char* dname=NULL;
+  char sname[20];
   size_t dlen;
   struct instancePrng* inst=malloc(sizeof(struct instancePrng));
 
@@ -27,6 +49,13 @@ createPrng(int id,int seed,const char* dist)
     goto error;
   }
 
+  if(nchan<=0)
+    nchan=1;
+  if(corr<0.0 || corr>1.0 || (corr!=0.0 && strcmp(dist,"Gaussian")!=0)){
+    epicsPrintf("Correlation must be in [0, 1], and needs Gaussian\n");
+    goto error;
+  }
+
   /* sizeof(dpreg)==strlen(dpref)+1 */
   dlen=sizeof(dpref)+strlen(dist);
   
@@ -52,6 +81,32 @@ createPrng(int id,int seed,const char* dist)
   }
 
   inst->id=id;
+  inst->nchan=nchan;
+  inst->corr=corr;
+  inst->lock=epicsMutexMustCreate();
+  inst->block=callocMustSucceed(nchan+1, sizeof(double), "createPrng");
+  inst->taken=callocMustSucceed(nchan, 1, "createPrng");
+  inst->used=callocMustSucceed(nchan, 1, "createPrng");
+  /* nothing generated yet */
+  memset(inst->taken, 1, nchan);
+  inst->ntaken=nchan;
+  inst->nused=0;
+  inst->rate=0.0;
+  scanIoInit(&inst->scan);
+
+  inst->offset=inst->table->raw_offset;
+  inst->scale=inst->table->raw_scale;
+  if(inst->scale==0.0)
+    inst->scale=1.0/(RAND_MAX+1.0);
+
+  /* statistics of this instance are found as "dist<id>",
+   * over the range of read_prng()
+   */
+  sprintf(sname,"dist%d",id);
+  inst->stats=prngStatsCreate(sname,
+                              (0.0-inst->offset)*inst->scale,
+                              (RAND_MAX+1.0-inst->offset)*inst->scale);
+
   ellAdd(&devices,&inst->node);
 
   return;
@@ -76,21 +131,290 @@ struct instancePrng* lookupPrng(short N)
   return NULL;
 }
 
+static
+void publishPrngSample(struct instancePrng* inst, unsigned chan, double val)
+{
+  if(shmring)
+    shmRingPut(shmring, inst->id, chan, val);
+}
+
+/* Read 'n' samples from the driver */
+static
+void readSamples(struct instancePrng* inst, double* z, unsigned n)
+{
+  unsigned i;
+
+  if(inst->table->read_prng_block) {
+    inst->table->read_prng_block(inst->token, z, n);
+  } else if(inst->table->read_prng_double) {
+    for(i=0; i<n; i++)
+      z[i]=inst->table->read_prng_double(inst->token);
+  } else {
+    for(i=0; i<n; i++)
+      z[i]=(inst->table->read_prng(inst->token)-inst->offset)*inst->scale;
+  }
+}
+
+/* Generate all channels at once.  With correlation, channel i is
+ * sqrt(c)*z0 + sqrt(1-c)*zi
+ * where z0 is common to all channels, which keeps the mean (0) and variance.
+ * Every sample generated is added to the statistics, and published, once.
+ */
+static
+void generateBlock(struct instancePrng* inst)
+{
+  unsigned i, n=inst->nchan + (inst->corr!=0.0);
+  double* z=inst->block;
+
+  readSamples(inst, z, n);
+
+  if(inst->corr!=0.0) {
+    /* drvPrngGaussian, the only driver with correlation, has mean 0 */
+    const double a=sqrt(inst->corr), b=sqrt(1.0-inst->corr);
+    const double common=a*z[n-1];
+
+    for(i=0; i<inst->nchan; i++)
+      z[i]=common + b*z[i];
+  }
+
+  for(i=0; i<inst->nchan; i++) {
+    prngStatsAdd(inst->stats, z[i]);
+    publishPrngSample(inst, i, z[i]);
+  }
+
+  memset(inst->taken, 0, inst->nchan);
+  inst->ntaken=0;
+}
+
+int readPrngRaw(struct instancePrng* inst)
+{
+  int val;
+  double x;
+
+  epicsMutexMustLock(inst->lock);
+  val=inst->table->read_prng(inst->token);
+  x=(val-inst->offset)*inst->scale;
+  prngStatsAdd(inst->stats, x);
+  publishPrngSample(inst, 0, x);
+  epicsMutexUnlock(inst->lock);
+
+  return val;
+}
+
+void readPrngArray(struct instancePrng* inst, double* out, unsigned n)
+{
+  unsigned i;
+
+  epicsMutexMustLock(inst->lock);
+  readSamples(inst, out, n);
+  for(i=0; i<n; i++) {
+    prngStatsAdd(inst->stats, out[i]);
+    publishPrngSample(inst, 0, out[i]);
+  }
+  epicsMutexUnlock(inst->lock);
+}
+
+void usePrngChannel(struct instancePrng* inst, unsigned chan)
+{
+  epicsMutexMustLock(inst->lock);
+  if(!inst->used[chan]) {
+    inst->used[chan]=1;
+    inst->nused++;
+  }
+  epicsMutexUnlock(inst->lock);
+}
+
+double readPrngChannel(struct instancePrng* inst, unsigned chan)
+{
+  double val;
+
+  epicsMutexMustLock(inst->lock);
+  /* A faster record repeats its value until the other channels
+   * have been read, so they don't skip samples.
+   */
+  if(inst->taken[chan] && inst->ntaken>=inst->nused && inst->rate<=0.0)
+    generateBlock(inst);
+  if(!inst->taken[chan]) {
+    inst->taken[chan]=1;
+    inst->ntaken+=inst->used[chan];
+  }
+  val=inst->block[chan];
+  epicsMutexUnlock(inst->lock);
+
+  return val;
+}
+
+/* Publish every sample generated to a new shared memory ring */
+void
+prngShmPublish(const char* name,int capacity)
+{
+  if(!name || !*name || capacity<=0){
+    epicsPrintf("Usage: prngShmPublish(\"/name\", capacity)\n");
+    return;
+  }
+  if(shmring){
+    epicsPrintf("Already publishing\n");
+    return;
+  }
+  shmring=shmRingCreate(name,capacity);
+  if(!shmring)
+    epicsPrintf("Failed to create shared memory ring %s\n",name);
+}
+
+/* Generate blocks for all instances with a rate, in one thread.
+ * Woken by setPrngRate() to pick up a new rate.
+ */
+static
+void producer(void* unused)
+{
+  while(1) {
+    ELLNODE* node;
+    epicsTimeStamp now;
+    double wait=-1.0;
+
+    epicsTimeGetCurrent(&now);
+
+    for(node=ellFirst(&devices); node; node=ellNext(node)){
+      struct instancePrng* inst=(struct instancePrng*)node;
+      double remain=-1.0;
+      int due;
+
+      epicsMutexMustLock(inst->lock);
+      if(inst->rate>0.0) {
+        remain=epicsTimeDiffInSeconds(&inst->next, &now);
+        due = remain<=0.0;
+        if(due) {
+          generateBlock(inst);
+
+          /* absolute deadlines, so the rate doesn't drift.
+           * Skip ahead if we have fallen far behind.
+           */
+          epicsTimeAddSeconds(&inst->next, 1.0/inst->rate);
+          remain=epicsTimeDiffInSeconds(&inst->next, &now);
+          if(remain < -1.0)
+            inst->next=now;
+        }
+        if(remain<0.0)
+          remain=0.0; /* behind, so no wait */
+      } else {
+        due = 0;
+      }
+      epicsMutexUnlock(inst->lock);
+
+      if(due)
+        scanIoRequest(inst->scan);
+
+      if(remain>=0.0 && (wait<0.0 || remain<wait))
+        wait=remain;
+    }
+
+    if(wait<0.0)
+      epicsEventMustWait(producerWake); /* no instance has a rate */
+    else if(wait>0.0)
+      (void)epicsEventWaitWithTimeout(producerWake, wait);
+  }
+}
+
+static
+void producerStart(void* unused)
+{
+  epicsThreadMustCreate("prngdist", epicsThreadPriorityMedium,
+                        epicsThreadGetStackSize(epicsThreadStackSmall),
+                        &producer, NULL);
+}
+
+static
+void startProducer(initHookState state)
+{
+  ELLNODE* node;
+  epicsTimeStamp now;
+  int any=0;
+
+  if(state!=initHookAfterInterruptAccept)
+    return;
+
+  epicsTimeGetCurrent(&now);
+  for(node=ellFirst(&devices); node; node=ellNext(node)){
+    struct instancePrng* inst=(struct instancePrng*)node;
+    epicsMutexMustLock(inst->lock);
+    inst->next=now;
+    any |= inst->rate>0.0;
+    epicsMutexUnlock(inst->lock);
+  }
+
+  if(any)
+    epicsThreadOnce(&producerOnce, &producerStart, NULL);
+}
+
+/* Generate blocks for instance 'id' at 'rate' per second, for
+ * records with SCAN="I/O Intr".  0 to stop.  May be called
+ * before or after iocInit.
+ */
+void
+setPrngRate(int id,double rate)
+{
+  struct instancePrng* inst=lookupPrng(id);
+
+  if(!inst){
+    epicsPrintf("No instance %d\n",id);
+    return;
+  }
+  if(rate<0.0)
+    rate=0.0;
+
+  epicsMutexMustLock(inst->lock);
+  if(inst->rate<=0.0)
+    epicsTimeGetCurrent(&inst->next); /* start now */
+  inst->rate=rate;
+  epicsMutexUnlock(inst->lock);
+
+  if(interruptAccept && rate>0.0)
+    epicsThreadOnce(&producerOnce, &producerStart, NULL);
+  epicsEventSignal(producerWake);
+}
 
 static const iocshArg createPrngArg0 = { "id#", iocshArgInt };
 static const iocshArg createPrngArg1 = { "Random Seed", iocshArgInt };
 static const iocshArg createPrngArg2 = { "Distribution", iocshArgString };
-static const iocshArg * const createPrngArgs[3] = 
-{ &createPrngArg0, &createPrngArg1, &createPrngArg2 };
+static const iocshArg createPrngArg3 = { "# of channels", iocshArgInt };
+static const iocshArg createPrngArg4 = { "correlation", iocshArgDouble };
+static const iocshArg * const createPrngArgs[5] = 
+{ &createPrngArg0, &createPrngArg1, &createPrngArg2, &createPrngArg3, &createPrngArg4 };
 static const iocshFuncDef createPrngFuncDef =
-{ "createPrng", 3, createPrngArgs };
+{ "createPrng", 5, createPrngArgs };
 static void createPrngCallFunc(const iocshArgBuf *args)
 {
-  createPrng(args[0].ival,args[1].ival,args[2].sval);
+  createPrng(args[0].ival,args[1].ival,args[2].sval,args[3].ival,args[4].dval);
+}
+
+static const iocshArg setPrngRateArg0 = { "id#", iocshArgInt };
+static const iocshArg setPrngRateArg1 = { "rate", iocshArgDouble };
+static const iocshArg * const setPrngRateArgs[2] = 
+{ &setPrngRateArg0, &setPrngRateArg1 };
+static const iocshFuncDef setPrngRateFuncDef =
+{ "setPrngRate", 2, setPrngRateArgs };
+static void setPrngRateCallFunc(const iocshArgBuf *args)
+{
+  setPrngRate(args[0].ival,args[1].dval);
+}
+
+static const iocshArg prngShmPublishArg0 = { "name", iocshArgString };
+static const iocshArg prngShmPublishArg1 = { "capacity", iocshArgInt };
+static const iocshArg * const prngShmPublishArgs[2] = 
+{ &prngShmPublishArg0, &prngShmPublishArg1 };
+static const iocshFuncDef prngShmPublishFuncDef =
+{ "prngShmPublish", 2, prngShmPublishArgs };
+static void prngShmPublishCallFunc(const iocshArgBuf *args)
+{
+  prngShmPublish(args[0].sval,args[1].ival);
 }
 
 void prngDist(void)
 {
   iocshRegister(&createPrngFuncDef, createPrngCallFunc);
+  iocshRegister(&setPrngRateFuncDef, setPrngRateCallFunc);
+  iocshRegister(&prngShmPublishFuncDef, prngShmPublishCallFunc);
+  producerWake=epicsEventMustCreate(epicsEventEmpty);
+  initHookRegister(&startProducer);
 }
 epicsExportRegistrar(prngDist);
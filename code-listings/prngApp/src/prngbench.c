@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dbAccess.h>
+#include <initHooks.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <iocsh.h>
+
+#ifdef __linux__
+#  include <sys/resource.h>
+#endif
+
+#include <epicsExport.h>
+
+/*
+ * Scaling benchmark.  Load many "Random Intr" (or other) records, and
+ * report the time from loading to a running IOC, and the memory
+ * and threads then in use.  prngBenchReport then gives the CPU time
+ * used while running, to compare the per-record timers of "Random
+ * Async" with the shared delay queue of "Random Async Sched".
+ */
+
+static epicsTimeStamp loadstart, runstart;
+static double runcpu;
+static int loaded;
+
+/* Process CPU time (user+system) in seconds, or -1 */
+static double prngCpuTime(void)
+{
+#ifdef __linux__
+  struct rusage ru;
+  if(getrusage(RUSAGE_SELF, &ru)!=0)
+    return -1.0;
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+       + 1e-6*(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+#else
+  return -1.0;
+#endif
+}
+
+/* Print resident memory and thread count (Linux only) */
+static void prngMemReport(void)
+{
+#ifdef __linux__
+  FILE* fp = fopen("/proc/self/status", "r");
+  char line[128];
+
+  if(!fp)
+    return;
+  while(fgets(line, sizeof(line), fp)) {
+    if(strncmp(line, "VmRSS:", 6)==0 || strncmp(line, "Threads:", 8)==0)
+      printf(" %s", line);
+  }
+  fclose(fp);
+#else
+  printf(" memory usage not available on this target\n");
+#endif
+}
+
+static void benchHook(initHookState state)
+{
+  epicsTimeStamp now;
+
+  if(state!=initHookAfterIocRunning || !loaded)
+    return;
+
+  epicsTimeGetCurrent(&now);
+  printf("prngBench: %.3f sec from loading records to IOC running\n",
+         epicsTimeDiffInSeconds(&now, &loadstart));
+  prngMemReport();
+
+  runstart = now;
+  runcpu = prngCpuTime();
+}
+
+/* CPU load since the IOC started running */
+static void prngBenchReport(void)
+{
+  epicsTimeStamp now;
+  double wall, cpu = prngCpuTime();
+
+  if(!loaded || runcpu<0.0 || cpu<0.0) {
+    printf("prngBenchReport: no prngBench running, or no CPU time on this target\n");
+    return;
+  }
+
+  epicsTimeGetCurrent(&now);
+  wall = epicsTimeDiffInSeconds(&now, &runstart);
+  printf("prngBench: %.2f CPU sec in %.2f sec running (%.1f%% of one core)\n",
+         cpu-runcpu, wall, wall>0 ? 100.0*(cpu-runcpu)/wall : 0.0);
+  prngMemReport();
+}
+
+/* Load 'count' records named <prefix><n> using 'nkeys' different seeds.
+ * 'dtyp' defaults to "Random Intr".  Other types are scanned at 10Hz.
+ */
+static void prngBench(const char* prefix, int count, int nkeys, const char* dtyp)
+{
+  char macros[128];
+  const char* scan = "I/O Intr";
+  int i;
+
+  if(!prefix || count<=0) {
+    printf("Usage: prngBench <prefix> <count> <# of seeds> [DTYP]\n");
+    return;
+  }
+  if(nkeys<=0)
+    nkeys = count;
+  if(!dtyp || !*dtyp)
+    dtyp = "Random Intr";
+  if(strcmp(dtyp, "Random Intr")!=0)
+    scan = ".1 second";
+
+  printf("prngBench: before loading\n");
+  prngMemReport();
+
+  epicsTimeGetCurrent(&loadstart);
+  if(!loaded)
+    initHookRegister(&benchHook);
+  loaded = 1;
+
+  for(i=0; i<count; i++) {
+    epicsSnprintf(macros, sizeof(macros),
+                  "P=%s%d,D=%s,SCAN=%s,S=%d",
+                  prefix, i, dtyp, scan, 1000+i%nkeys);
+    dbLoadRecords("db/prng.db", macros);
+  }
+}
+
+static const iocshArg prngBenchArg0 = { "prefix", iocshArgString };
+static const iocshArg prngBenchArg1 = { "# of records", iocshArgInt };
+static const iocshArg prngBenchArg2 = { "# of seeds", iocshArgInt };
+static const iocshArg prngBenchArg3 = { "DTYP", iocshArgString };
+static const iocshArg * const prngBenchArgs[4] =
+{ &prngBenchArg0, &prngBenchArg1, &prngBenchArg2, &prngBenchArg3 };
+static const iocshFuncDef prngBenchFuncDef =
+{ "prngBench", 4, prngBenchArgs };
+static void prngBenchCallFunc(const iocshArgBuf *args)
+{
+  prngBench(args[0].sval,args[1].ival,args[2].ival,args[3].sval);
+}
+
+static const iocshFuncDef prngBenchReportFuncDef =
+{ "prngBenchReport", 0, NULL };
+static void prngBenchReportCallFunc(const iocshArgBuf *args)
+{
+  prngBenchReport();
+}
+
+static void prngBenchRegister(void)
+{
+  iocshRegister(&prngBenchFuncDef, prngBenchCallFunc);
+  iocshRegister(&prngBenchReportFuncDef, prngBenchReportCallFunc);
+}
+epicsExportRegistrar(prngBenchRegister);
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dbAccess.h>
+#include <recGbl.h>
+#include <dbDefs.h>
+
+#include "prngengine.h"
+
+static const struct {
+  const char* name;
+  enum prngEngineType type;
+} engines[] = {
+  {"rand_r", prngEngineRandR},
+  {"pcg32", prngEnginePCG32},
+  {"xoshiro256++", prngEngineXoshiro256pp},
+  {"splitmix64", prngEngineSplitmix64},
+};
+
+const char* prngEngineName(enum prngEngineType type)
+{
+  unsigned i;
+  for(i=0; i<NELEMENTS(engines); i++) {
+    if(engines[i].type==type)
+      return engines[i].name;
+  }
+  return "?";
+}
+
+int prngEngineInit(struct prngEngine* eng, const char* name, unsigned long seed)
+{
+  unsigned i;
+  prngU64 sm = seed;
+
+  for(i=0; i<NELEMENTS(engines); i++) {
+    if(strcmp(engines[i].name, name)==0)
+      break;
+  }
+  if(i==NELEMENTS(engines))
+    return 1;
+
+  memset(eng, 0, sizeof(*eng));
+  eng->type = engines[i].type;
+
+  switch(eng->type) {
+  case prngEngineRandR:
+    eng->s.randr = seed;
+    break;
+  case prngEnginePCG32:
+    eng->s.pcg.inc = (prngSplitmix64(&sm) << 1u) | 1u;
+    eng->s.pcg.state = 0;
+    (void)prngEngineNext(eng);
+    eng->s.pcg.state += seed;
+    (void)prngEngineNext(eng);
+    break;
+  case prngEngineXoshiro256pp:
+    /* state must not be all zero, which splitmix64 never gives */
+    eng->s.xoshiro[0] = prngSplitmix64(&sm);
+    eng->s.xoshiro[1] = prngSplitmix64(&sm);
+    eng->s.xoshiro[2] = prngSplitmix64(&sm);
+    eng->s.xoshiro[3] = prngSplitmix64(&sm);
+    break;
+  case prngEngineSplitmix64:
+    eng->s.splitmix = seed;
+    break;
+  }
+  return 0;
+}
+
+long prngEngineInitLink(struct prngEngine* eng, dbCommon* prec, DBLINK* inp)
+{
+  unsigned long seed = 0;
+  char name[16] = "rand_r";
+
+  if(inp->type==CONSTANT) {
+    recGblInitConstantLink(inp,DBF_ULONG,&seed);
+
+  } else if(inp->type==INST_IO) {
+    const char* str = inp->value.instio.string;
+    int n = 0;
+
+    if(sscanf(str, "%lu%n", &seed, &n)!=1 ||
+       (str[n] && sscanf(str+n, " engine=%15s", name)!=1))
+    {
+      recGblRecordError(S_db_badField, (void*)prec,
+        "INP must be \"@<seed> [engine=<name>]\"");
+      return S_db_badField;
+    }
+
+  } else {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Unsupported link type");
+    return S_db_badField;
+  }
+
+  if(prngEngineInit(eng, name, seed)) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Unknown engine.  Use rand_r, pcg32, xoshiro256++, or splitmix64");
+    return S_db_badField;
+  }
+  return 0;
+}
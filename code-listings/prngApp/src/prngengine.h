@@ -0,0 +1,111 @@
+
+#ifndef PRNGENGINE_H
+#define PRNGENGINE_H 1
+
+#include <stdlib.h>
+
+#include <dbCommon.h>
+#include <link.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Registry of PRNG engines shared by the "Random*" device supports.
+ *
+ * The state of every engine fits inline in struct prngEngine.
+ * prngEngineNext() switches on the engine type instead of calling
+ * through a pointer, so it can be inlined into the read function.
+ * All engines return 31 bit values, like rand_r().
+ */
+
+#if defined(_MSC_VER)
+#  define PRNG_INLINE static __inline
+#else
+#  define PRNG_INLINE static __inline__
+#endif
+
+typedef unsigned long long prngU64;
+
+enum prngEngineType {
+  prngEngineRandR,
+  prngEnginePCG32,
+  prngEngineXoshiro256pp,
+  prngEngineSplitmix64
+};
+
+struct prngEngine {
+  enum prngEngineType type;
+  union {
+    unsigned int randr;
+    struct { prngU64 state, inc; } pcg;
+    prngU64 xoshiro[4];
+    prngU64 splitmix;
+  } s;
+};
+
+/* Seed an engine by name ("rand_r", "pcg32", "xoshiro256++", "splitmix64").
+ * Returns non-zero if the name is not known.
+ */
+int prngEngineInit(struct prngEngine* eng, const char* name, unsigned long seed);
+
+/* Initialize from the INP link of a record.
+ * A CONSTANT link gives the seed for rand_r.
+ * An INST_IO link is "@<seed> [engine=<name>]".
+ * Returns 0 or an error code, after printing a record error.
+ */
+long prngEngineInitLink(struct prngEngine* eng, dbCommon* prec, DBLINK* inp);
+
+/* Name of an engine type */
+const char* prngEngineName(enum prngEngineType type);
+
+PRNG_INLINE prngU64 prngRotl64(prngU64 x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+PRNG_INLINE prngU64 prngSplitmix64(prngU64* s)
+{
+  prngU64 z = (*s += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+PRNG_INLINE unsigned int prngEngineNext(struct prngEngine* eng)
+{
+  switch(eng->type) {
+  case prngEnginePCG32: {
+    prngU64 old = eng->s.pcg.state;
+    unsigned int xorshifted, rot;
+    eng->s.pcg.state = old * 6364136223846793005ULL + eng->s.pcg.inc;
+    xorshifted = (unsigned int)(((old >> 18u) ^ old) >> 27u);
+    rot = (unsigned int)(old >> 59u);
+    return ((xorshifted >> rot) | (xorshifted << ((-rot) & 31))) >> 1;
+  }
+  case prngEngineXoshiro256pp: {
+    prngU64 *s = eng->s.xoshiro;
+    prngU64 result = prngRotl64(s[0] + s[3], 23) + s[0];
+    prngU64 t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prngRotl64(s[3], 45);
+    return (unsigned int)(result >> 33);
+  }
+  case prngEngineSplitmix64:
+    return (unsigned int)(prngSplitmix64(&eng->s.splitmix) >> 33);
+  case prngEngineRandR:
+  default:
+    return rand_r(&eng->s.randr);
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRNGENGINE_H */
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <iocsh.h>
+#include <ellLib.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <callback.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "prnggov.h"
+
+#include <epicsExport.h>
+
+volatile double prngGovScale = 1.0;
+volatile int prngGovEnabled;
+
+/* Lower bound of prngGovScale */
+#define GOV_MIN_SCALE (1.0/1024)
+/* Added to prngGovScale after each interval within budget */
+#define GOV_STEP_UP 0.05
+
+struct prngGovClient {
+  ELLNODE node;
+  const char* name;
+  double nominal;
+  unsigned long count; /* updated by the generator thread */
+  unsigned long lastcount;
+  double rate; /* effective, over the last interval */
+};
+
+struct probe {
+  CALLBACK cb;
+  epicsTimeStamp queued;
+  int pending;
+  double delay; /* of the last probe to run */
+};
+
+static struct {
+  epicsMutexId lock;
+  ELLLIST clients; /* all zeros is an empty list */
+  struct probe probes[NUM_CALLBACK_PRIORITIES];
+  double budget; /* sec. */
+  double interval; /* sec. */
+  double latency; /* worst reported this interval */
+  double load; /* worst of all, last interval */
+  epicsThreadId thread;
+} gov;
+
+static epicsThreadOnceId govOnce = EPICS_THREAD_ONCE_INIT;
+
+static void govInit(void* unused)
+{
+  gov.lock = epicsMutexMustCreate();
+}
+
+struct prngGovClient* prngGovAdd(const char* name, double nominal)
+{
+  struct prngGovClient* cli;
+
+  epicsThreadOnce(&govOnce, &govInit, NULL);
+
+  cli = callocMustSucceed(1, sizeof(*cli), "prngGovAdd");
+  cli->name = name;
+  cli->nominal = nominal;
+
+  epicsMutexMustLock(gov.lock);
+  ellAdd(&gov.clients, &cli->node);
+  epicsMutexUnlock(gov.lock);
+  return cli;
+}
+
+void prngGovCount(struct prngGovClient* cli, unsigned n)
+{
+  cli->count += n;
+}
+
+void prngGovLatency(double sec)
+{
+  epicsMutexMustLock(gov.lock);
+  if(sec > gov.latency)
+    gov.latency = sec;
+  epicsMutexUnlock(gov.lock);
+}
+
+void prngGovPace(double period, double busy)
+{
+  double scale = prngGovScale;
+  double wait = period;
+
+  if(scale<1.0)
+    wait = (period+busy)/scale - busy;
+  if(wait>0.0)
+    epicsThreadSleep(wait);
+}
+
+static void probeRun(CALLBACK* cb)
+{
+  struct probe* pr;
+  epicsTimeStamp now;
+
+  callbackGetUser(pr, cb);
+  epicsTimeGetCurrent(&now);
+
+  epicsMutexMustLock(gov.lock);
+  pr->delay = epicsTimeDiffInSeconds(&now, &pr->queued);
+  pr->pending = 0;
+  epicsMutexUnlock(gov.lock);
+}
+
+static void govWorker(void* unused)
+{
+  epicsTimeStamp now, last;
+  ELLNODE* node;
+  int prio;
+
+  epicsTimeGetCurrent(&last);
+
+  while(1) {
+    double load = 0.0, elapsed;
+
+    epicsThreadSleep(gov.interval);
+    if(!interruptAccept)
+      continue; /* callbacks not running yet */
+
+    epicsTimeGetCurrent(&now);
+    elapsed = epicsTimeDiffInSeconds(&now, &last);
+    last = now;
+
+    epicsMutexMustLock(gov.lock);
+
+    /* queue delay at each priority.  A probe still waiting
+     * counts as delayed for as long as it has waited.
+     */
+    for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++) {
+      struct probe* pr = &gov.probes[prio];
+      double delay = pr->delay;
+
+      if(pr->pending)
+        delay = epicsTimeDiffInSeconds(&now, &pr->queued);
+      if(delay > load)
+        load = delay;
+
+      if(!pr->pending) {
+        pr->pending = 1;
+        pr->queued = now;
+        if(callbackRequest(&pr->cb))
+          pr->pending = 0; /* queue full, try again next time */
+      }
+    }
+
+    if(gov.latency > load)
+      load = gov.latency;
+    gov.latency = 0.0;
+    gov.load = load;
+
+    for(node=ellFirst(&gov.clients); node; node=ellNext(node)) {
+      struct prngGovClient* cli = CONTAINER(node, struct prngGovClient, node);
+      unsigned long count = cli->count;
+      cli->rate = elapsed>0.0 ? (count - cli->lastcount)/elapsed : 0.0;
+      cli->lastcount = count;
+    }
+
+    epicsMutexUnlock(gov.lock);
+
+    /* additive increase, multiplicative decrease */
+    if(load > gov.budget) {
+      prngGovScale = prngGovScale/2 > GOV_MIN_SCALE ? prngGovScale/2 : GOV_MIN_SCALE;
+    } else if(prngGovScale < 1.0) {
+      prngGovScale = prngGovScale+GOV_STEP_UP < 1.0 ? prngGovScale+GOV_STEP_UP : 1.0;
+    }
+  }
+}
+
+/* Start the governor, or change its budget and interval */
+static void prngGovernor(double budget, double interval)
+{
+  int prio;
+
+  if(budget<=0.0) {
+    printf("Usage: prngGovernor <max latency sec> <interval sec>\n");
+    return;
+  }
+  if(interval<=0.0)
+    interval = 1.0;
+
+  epicsThreadOnce(&govOnce, &govInit, NULL);
+
+  gov.budget = budget;
+  gov.interval = interval;
+
+  if(gov.thread)
+    return;
+
+  for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++) {
+    callbackSetCallback(probeRun, &gov.probes[prio].cb);
+    callbackSetPriority(prio, &gov.probes[prio].cb);
+    callbackSetUser(&gov.probes[prio], &gov.probes[prio].cb);
+  }
+
+  prngGovEnabled = 1;
+  gov.thread = epicsThreadMustCreate("prnggov", epicsThreadPriorityLow,
+                                     epicsThreadGetStackSize(epicsThreadStackSmall),
+                                     &govWorker, NULL);
+}
+
+static void prngGovStatus(void)
+{
+  ELLNODE* node;
+  int prio;
+
+  epicsThreadOnce(&govOnce, &govInit, NULL);
+
+  epicsMutexMustLock(gov.lock);
+  if(!gov.thread) {
+    printf("Governor not running.  Start with prngGovernor\n");
+  } else {
+    printf("scale=%.4f budget=%g sec load=%g sec, queue delay", prngGovScale,
+           gov.budget, gov.load);
+    for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++)
+      printf(" %g", gov.probes[prio].delay);
+    printf(" sec (low, medium, high)\n");
+  }
+  for(node=ellFirst(&gov.clients); node; node=ellNext(node)) {
+    struct prngGovClient* cli = CONTAINER(node, struct prngGovClient, node);
+    if(cli->nominal>0.0)
+      printf(" %s nominal=%g effective=%.1f values/sec\n",
+             cli->name, cli->nominal, cli->rate);
+    else
+      printf(" %s nominal=unpaced effective=%.1f values/sec\n",
+             cli->name, cli->rate);
+  }
+  epicsMutexUnlock(gov.lock);
+}
+
+static const iocshArg prngGovernorArg0 = { "max latency (sec)", iocshArgDouble };
+static const iocshArg prngGovernorArg1 = { "interval (sec)", iocshArgDouble };
+static const iocshArg * const prngGovernorArgs[2] =
+{ &prngGovernorArg0, &prngGovernorArg1 };
+static const iocshFuncDef prngGovernorFuncDef = { "prngGovernor", 2, prngGovernorArgs };
+static void prngGovernorCallFunc(const iocshArgBuf *args)
+{
+  prngGovernor(args[0].dval, args[1].dval);
+}
+
+static const iocshFuncDef prngGovStatusFuncDef = { "prngGovStatus", 0, NULL };
+static void prngGovStatusCallFunc(const iocshArgBuf *args)
+{
+  prngGovStatus();
+}
+
+void prngGovRegister(void)
+{
+  iocshRegister(&prngGovernorFuncDef, prngGovernorCallFunc);
+  iocshRegister(&prngGovStatusFuncDef, prngGovStatusCallFunc);
+}
+epicsExportRegistrar(prngGovRegister);
@@ -0,0 +1,44 @@
+
+#ifndef PRNGGOV_H
+#define PRNGGOV_H 1
+
+/*
+ * Rate governor for the PRNG generator threads.
+ *
+ * Once started with prngGovernor(), a thread queues a probe callback
+ * at each callback priority every interval and measures how long it
+ * waits in the queue.  Generators also report how long their scans
+ * took to complete.  When the worst of these exceeds the budget,
+ * prngGovScale is halved.  Otherwise it recovers in steps back to 1.
+ *
+ * Generators multiply their rate by prngGovScale, most simply by
+ * calling prngGovPace() in place of epicsThreadSleep().
+ */
+
+/* Fraction of its nominal rate each generator should run at, in (0,1] */
+extern volatile double prngGovScale;
+
+/* Non-zero while the governor runs.  Gates latency measurement. */
+extern volatile int prngGovEnabled;
+
+struct prngGovClient;
+
+/* Add a generator, for the status report.  'nominal' is its
+ * rate in values per second, or 0 if it runs as fast as it can.
+ * 'name' must never be freed.
+ */
+struct prngGovClient* prngGovAdd(const char* name, double nominal);
+
+/* Count values produced */
+void prngGovCount(struct prngGovClient* cli, unsigned n);
+
+/* Report the time from queuing a scan until it completed */
+void prngGovLatency(double sec);
+
+/* Sleep to end one cycle of a generator.  Without the governor
+ * this sleeps 'period'.  With it, the whole cycle, including
+ * 'busy' seconds of work, is stretched by 1/prngGovScale.
+ */
+void prngGovPace(double period, double busy);
+
+#endif /* PRNGGOV_H */
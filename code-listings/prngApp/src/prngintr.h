@@ -0,0 +1,48 @@
+
+#ifndef PRNGINTR_H
+#define PRNGINTR_H 1
+
+#include <dbCommon.h>
+#include <link.h>
+#include <dbScan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * I/O Intr generators (devprngintr.c) shared by the "Random Intr"
+ * device supports of every record type (devprngrec.cpp).
+ *
+ * Records with the same engine, seed and period share one generator
+ * thread.  Records with the same decimation share one scan list.
+ */
+
+/* Register the hook which starts the generators.
+ * Call from dset init().  Repeated calls do nothing.
+ */
+void prngIntrInit(void);
+
+/* Attach a record to a generator and set prec->dpvt.
+ * INP is a CONSTANT seed, or INST_IO
+ * "@<seed> [period=<sec>] [decim=<N>] [reduce=last|mean|max] [engine=<name>]"
+ * 'dev' names the calling device support for prngIntrReport().
+ */
+long prngIntrInitRecord(dbCommon* prec, DBLINK* inp, const char* dev);
+
+/* For dset get_ioint_info() */
+long prngIntrGetIoint(int dir, dbCommon* prec, IOSCANPVT* io);
+
+/* Latest (reduced) value for a record.  31 bits. */
+unsigned int prngIntrRead(dbCommon* prec);
+
+/* Print the state and wakeups/sec of each generator
+ * read by records of device support 'dev'
+ */
+void prngIntrReport(int level, const char* dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PRNGINTR_H */
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <dbAccess.h>
+#include <devSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <dbDefs.h>
+#include <ellLib.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <epicsMutex.h>
+#include <iocsh.h>
+
+#include <devLib.h> /* for noDevice error code */
+
+#include <aiRecord.h>
+#include <waveformRecord.h>
+#include <menuFtype.h>
+
+#include "prngstats.h"
+
+#include <epicsExport.h>
+
+static ELLLIST allstats = ELLLIST_INIT;
+
+static
+void statsReset(struct prngStats* stats)
+{
+  stats->count = 0;
+  stats->mean = stats->m2 = 0.0;
+  stats->min = stats->max = 0.0;
+  memset(stats->hist, 0, sizeof(stats->hist));
+}
+
+struct prngStats* prngStatsCreate(const char* name, double lo, double hi)
+{
+  struct prngStats* stats = callocMustSucceed(1, sizeof(*stats), "prngStatsCreate");
+
+  stats->name = epicsStrDup(name);
+  stats->lock = epicsMutexMustCreate();
+  stats->lo = lo;
+  stats->hi = hi;
+  statsReset(stats);
+
+  ellAdd(&allstats, &stats->node);
+  return stats;
+}
+
+void prngStatsAdd(struct prngStats* stats, double x)
+{
+  double delta;
+  long bin;
+
+  bin = (long)((x - stats->lo) * PRNG_STATS_NBINS / (stats->hi - stats->lo));
+  if(bin<0)
+    bin = 0;
+  else if(bin>=PRNG_STATS_NBINS)
+    bin = PRNG_STATS_NBINS-1;
+
+  epicsMutexMustLock(stats->lock);
+
+  stats->count++;
+  delta = x - stats->mean;
+  stats->mean += delta/stats->count;
+  stats->m2 += delta*(x - stats->mean);
+
+  if(stats->count==1 || x<stats->min)
+    stats->min = x;
+  if(stats->count==1 || x>stats->max)
+    stats->max = x;
+
+  stats->hist[bin]++;
+
+  epicsMutexUnlock(stats->lock);
+}
+
+static
+struct prngStats* lookupStats(const char* name)
+{
+  ELLNODE* node;
+
+  for(node=ellFirst(&allstats); node; node=ellNext(node)){
+    struct prngStats* stats = (struct prngStats*)node;
+    if(strcmp(stats->name, name)==0)
+      return stats;
+  }
+  return NULL;
+}
+
+/* Which statistic an ai record reads */
+enum statsField {statsCount, statsMean, statsVar, statsStd, statsMin, statsMax};
+
+static const char* const statsFieldNames[] = {"count", "mean", "var", "std", "min", "max"};
+
+struct statsPvt {
+  struct prngStats* stats;
+  enum statsField field;
+};
+
+static long init_record_ai(aiRecord *prec)
+{
+  struct statsPvt* priv;
+  char name[64], field[8];
+  unsigned i;
+
+  if(sscanf(prec->inp.value.instio.string, "%63s %7s", name, field)!=2) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "INP must be \"@<stream> <count|mean|var|std|min|max>\"");
+    return S_db_badField;
+  }
+
+  for(i=0; i<NELEMENTS(statsFieldNames); i++) {
+    if(strcmp(field, statsFieldNames[i])==0)
+      break;
+  }
+
+  priv = callocMustSucceed(1, sizeof(*priv), "prngstats");
+  priv->stats = lookupStats(name);
+  priv->field = (enum statsField)i;
+
+  if(!priv->stats || i==NELEMENTS(statsFieldNames)) {
+    free(priv);
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid stream or statistic");
+    return S_dev_noDevice;
+  }
+
+  priv->stats->nreaders++;
+  prec->dpvt = priv;
+
+  return 0;
+}
+
+static long read_ai(aiRecord *prec)
+{
+  struct statsPvt* priv = prec->dpvt;
+  struct prngStats* stats;
+  double val = 0.0;
+
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+  stats = priv->stats;
+
+  epicsMutexMustLock(stats->lock);
+  switch(priv->field) {
+  case statsCount: val = stats->count; break;
+  case statsMean:  val = stats->mean; break;
+  case statsVar:   val = stats->count>1 ? stats->m2/(stats->count-1) : 0.0; break;
+  case statsStd:   val = stats->count>1 ? sqrt(stats->m2/(stats->count-1)) : 0.0; break;
+  case statsMin:   val = stats->min; break;
+  case statsMax:   val = stats->max; break;
+  }
+  if(stats->count==0)
+    (void)recGblSetSevr(prec, UDF_ALARM, INVALID_ALARM);
+  epicsMutexUnlock(stats->lock);
+
+  prec->val = val;
+  prec->udf = 0;
+
+  return 2; /* don't convert */
+}
+
+static long init_record_wf(waveformRecord *prec)
+{
+  struct prngStats* stats;
+  char name[64];
+
+  if(prec->ftvl!=menuFtypeLONG) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "Histogram requires FTVL=LONG");
+    return S_db_badField;
+  }
+
+  if(sscanf(prec->inp.value.instio.string, "%63s", name)!=1 ||
+     !(stats = lookupStats(name)))
+  {
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid stream");
+    return S_dev_noDevice;
+  }
+
+  stats->nreaders++;
+  prec->dpvt = stats;
+
+  return 0;
+}
+
+static long read_wf(waveformRecord *prec)
+{
+  struct prngStats* stats = prec->dpvt;
+  epicsInt32* buf = prec->bptr;
+  unsigned i, n = PRNG_STATS_NBINS;
+
+  if(!stats) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  if(n>prec->nelm)
+    n = prec->nelm;
+
+  epicsMutexMustLock(stats->lock);
+  for(i=0; i<n; i++)
+    buf[i] = (epicsInt32)stats->hist[i];
+  epicsMutexUnlock(stats->lock);
+
+  prec->nord = n;
+
+  return 0;
+}
+
+/* List all streams */
+static long report(int level)
+{
+  ELLNODE* node;
+
+  for(node=ellFirst(&allstats); node; node=ellNext(node)){
+    struct prngStats* stats = (struct prngStats*)node;
+    unsigned long count;
+    double mean;
+
+    epicsMutexMustLock(stats->lock);
+    count = stats->count;
+    mean = stats->mean;
+    epicsMutexUnlock(stats->lock);
+
+    printf(" %s count=%lu mean=%g\n", stats->name, count, mean);
+  }
+  return 0;
+}
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_ai;
+  DEVSUPFUN  special_linconv;
+} devAiPrngStats = {
+  6, /* space for 6 functions */
+  report,
+  NULL,
+  init_record_ai,
+  NULL,
+  read_ai,
+  NULL
+};
+epicsExportAddress(dset,devAiPrngStats);
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_wf;
+} devWfPrngStats = {
+  5, /* space for 5 functions */
+  NULL, /* reported by devAiPrngStats */
+  NULL,
+  init_record_wf,
+  NULL,
+  read_wf
+};
+epicsExportAddress(dset,devWfPrngStats);
+
+/* Clear the statistics of one stream, or all if name is empty */
+void prngStatsReset(const char* name)
+{
+  ELLNODE* node;
+
+  for(node=ellFirst(&allstats); node; node=ellNext(node)){
+    struct prngStats* stats = (struct prngStats*)node;
+    if(name && name[0] && strcmp(stats->name, name)!=0)
+      continue;
+    epicsMutexMustLock(stats->lock);
+    statsReset(stats);
+    epicsMutexUnlock(stats->lock);
+  }
+}
+
+static const iocshArg prngStatsResetArg0 = { "stream", iocshArgString };
+static const iocshArg * const prngStatsResetArgs[1] =
+{ &prngStatsResetArg0 };
+static const iocshFuncDef prngStatsResetFuncDef =
+{ "prngStatsReset", 1, prngStatsResetArgs };
+static void prngStatsResetCallFunc(const iocshArgBuf *args)
+{
+  prngStatsReset(args[0].sval);
+}
+
+void prngStatsRegister(void)
+{
+  iocshRegister(&prngStatsResetFuncDef, prngStatsResetCallFunc);
+}
+epicsExportRegistrar(prngStatsRegister);
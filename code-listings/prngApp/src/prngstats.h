@@ -0,0 +1,39 @@
+
+#ifndef PRNGSTATS_H
+#define PRNGSTATS_H 1
+
+#include <ellLib.h>
+#include <epicsMutex.h>
+
+/* Number of histogram bins */
+#define PRNG_STATS_NBINS 16
+
+/* Running statistics of a stream of samples.
+ * Updated for every sample generated, and read by
+ * the "Random Stats" device support at a lower rate.
+ */
+struct prngStats {
+  ELLNODE node; /* must be first */
+  char* name;
+  epicsMutexId lock;
+  unsigned nreaders; /* "Random Stats" records.  Set during init */
+
+  unsigned long count;
+  double mean, m2; /* Welford's running mean and sum of squared deviations */
+  double min, max;
+
+  /* histogram of [lo, hi) */
+  double lo, hi;
+  unsigned long hist[PRNG_STATS_NBINS];
+};
+
+/* Create and register a new statistics block which the
+ * "Random Stats" device support will find by name.
+ * Samples are expected in the range [lo, hi).
+ */
+struct prngStats* prngStatsCreate(const char* name, double lo, double hi);
+
+/* Add one sample */
+void prngStatsAdd(struct prngStats* stats, double x);
+
+#endif /* PRNGSTATS_H */
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <dbEvent.h>
+#include <link.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+#include <epicsVersion.h>
+#include <menuScan.h>
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,15,0,1)
+#  define USE_DBCHANNEL
+#  include <dbChannel.h>
+#endif
+#endif
+
+#include "scanprio.h"
+
+#include <epicsExport.h>
+
+double prngIdleCheck = 0.0;
+epicsExportAddress(double, prngIdleCheck);
+
+static const char* prioName[NUM_CALLBACK_PRIORITIES] = {"low", "medium", "high"};
+
+void scanPrioUpdate(struct scanPrio* sp, int dir, const dbCommon* prec)
+{
+  unsigned prio = prec->prio;
+
+  if(prio>=NUM_CALLBACK_PRIORITIES)
+    return;
+
+  if(dir==0)
+    sp->count[prio]++;
+  else if(sp->count[prio]>0)
+    sp->count[prio]--;
+
+  if(sp->count[prio])
+    sp->mask |= 1u<<prio;
+  else
+    sp->mask &= ~(1u<<prio);
+}
+
+int scanPrioRecordActive(const dbCommon* prec)
+{
+  if(prec->scan!=menuScanI_O_Intr)
+    return 0;
+  /* DISA from an SDIS link changes only when the record is processed */
+  if(prec->sdis.type!=CONSTANT)
+    return 1;
+  /* racy read, but a stale answer only delays parking or waking */
+  return prec->disa!=prec->disv;
+}
+
+/* Monitors of DISA and DISV, from one event task */
+static dbEventCtx watchCtx;
+static epicsThreadOnceId watchOnce = EPICS_THREAD_ONCE_INIT;
+
+static void watchInit(void* unused)
+{
+  watchCtx = db_init_events();
+  if(watchCtx && db_start_events(watchCtx, "prngWatch", NULL, NULL,
+                                 epicsThreadPriorityLow)!=DB_EVENT_OK)
+    watchCtx = NULL;
+  if(!watchCtx)
+    errlogPrintf("scanPrioWatch: no event task.  Set prngIdleCheck to find re-enabled records\n");
+}
+
+#ifdef USE_DBCHANNEL
+static void watchEvent(void* user, struct dbChannel* chan,
+                       int eventsRemaining, struct db_field_log* pfl)
+#else
+static void watchEvent(void* user, struct dbAddr* paddr,
+                       int eventsRemaining, struct db_field_log* pfl)
+#endif
+{
+  epicsEventSignal((epicsEventId)user);
+}
+
+static void watchField(dbCommon* prec, const char* field, epicsEventId wake)
+{
+  char name[PVNAME_STRINGSZ+8];
+  dbEventSubscription sub = NULL;
+#ifdef USE_DBCHANNEL
+  dbChannel* chan;
+#else
+  DBADDR* chan;
+#endif
+
+  epicsSnprintf(name, sizeof(name), "%s.%s", prec->name, field);
+
+  /* never freed, like the subscription */
+#ifdef USE_DBCHANNEL
+  chan = dbChannelCreate(name);
+  if(chan && dbChannelOpen(chan)) {
+    dbChannelDelete(chan);
+    chan = NULL;
+  }
+#else
+  chan = callocMustSucceed(1, sizeof(*chan), "scanPrioWatch");
+  if(dbNameToAddr(name, chan)) {
+    free(chan);
+    chan = NULL;
+  }
+#endif
+
+  if(chan)
+    sub = db_add_event(watchCtx, chan, &watchEvent, wake, DBE_VALUE);
+  if(!sub) {
+    errlogPrintf("scanPrioWatch: can't monitor %s\n", name);
+    return;
+  }
+  db_event_enable(sub);
+}
+
+void scanPrioWatch(dbCommon* prec, epicsEventId wake)
+{
+  epicsThreadOnce(&watchOnce, &watchInit, NULL);
+  if(!watchCtx)
+    return;
+  watchField(prec, "DISA", wake);
+  watchField(prec, "DISV", wake);
+}
+
+void scanPrioPark(epicsEventId wake)
+{
+  if(prngIdleCheck>0.0)
+    (void)epicsEventWaitWithTimeout(wake, prngIdleCheck);
+  else
+    epicsEventMustWait(wake);
+}
+
+void scanPrioCostInit(struct scanPrioCost* cost, const char* dset)
+{
+  char name[64];
+  int prio;
+
+  for(prio=0; prio<NUM_CALLBACK_PRIORITIES; prio++) {
+    epicsSnprintf(name, sizeof(name), "%s.dispatch.%s", dset, prioName[prio]);
+    cost->dispatch[prio] = perfCounterGet(name);
+    epicsSnprintf(name, sizeof(name), "%s.dispatchNs.%s", dset, prioName[prio]);
+    cost->ns[prio] = perfCounterGet(name);
+  }
+}
+
+void scanPrioCostAdd(struct scanPrioCost* cost, int prio, const epicsTimeStamp* start)
+{
+  perfCounterInc(cost->dispatch[prio]);
+  if(start) {
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    perfCounterAdd(cost->ns[prio], (size_t)(epicsTimeDiffInSeconds(&now, start)*1e9));
+  }
+}
@@ -0,0 +1,61 @@
+
+#ifndef SCANPRIO_H
+#define SCANPRIO_H 1
+
+#include <dbCommon.h>
+#include <callback.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+
+#include "perfcount.h"
+
+/*
+ * Which callback priorities have records on an I/O Intr scan list,
+ * so that device support dispatches only to those.
+ *
+ * get_ioint_info() is called with dir=0 when a record is added to
+ * a scan list, and dir=1 when it is removed (also around changes
+ * of SCAN or PRIO).  Call scanPrioUpdate() from there.
+ * The caller provides locking.
+ */
+struct scanPrio {
+  unsigned count[NUM_CALLBACK_PRIORITIES];
+  unsigned mask; /* bit 'prio' set while count[prio]>0 */
+};
+
+void scanPrioUpdate(struct scanPrio* sp, int dir, const dbCommon* prec);
+
+/* Is 'prec' an I/O Intr record which is not disabled */
+int scanPrioRecordActive(const dbCommon* prec);
+
+/* Signal 'wake' when DISA or DISV of 'prec' is changed.  Call once
+ * for each record after iocInit has initialized the database.
+ */
+void scanPrioWatch(dbCommon* prec, epicsEventId wake);
+
+/* Seconds between checks of a parked generator for records
+ * which have been re-enabled.  Only needed if DISA is changed
+ * without posting a monitor.  The default 0 waits for 'wake'.
+ */
+extern double prngIdleCheck;
+
+/* Park a generator with no active records until 'wake' is signaled,
+ * or for prngIdleCheck.  get_ioint_info() signals 'wake' when a record
+ * is added to the scan list, and scanPrioWatch() when one is enabled.
+ */
+void scanPrioPark(epicsEventId wake);
+
+/* Counters "<dset>.dispatch.<prio>" and "<dset>.dispatchNs.<prio>" */
+struct scanPrioCost {
+  struct perfCounter* dispatch[NUM_CALLBACK_PRIORITIES];
+  struct perfCounter* ns[NUM_CALLBACK_PRIORITIES];
+};
+
+void scanPrioCostInit(struct scanPrioCost* cost, const char* dset);
+
+/* Count one dispatch to 'prio'.  If 'start' is not NULL
+ * also add the time since 'start'.
+ */
+void scanPrioCostAdd(struct scanPrioCost* cost, int prio, const epicsTimeStamp* start);
+
+#endif /* SCANPRIO_H */
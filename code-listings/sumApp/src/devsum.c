@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dbAccess.h>
+#include <devSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <dbScan.h>
+#include <dbDefs.h>
+#include <ellLib.h>
+#include <cantProceed.h>
+#include <epicsMutex.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <devLib.h> /* for noDevice error code */
+
+#include <aiRecord.h>
+#include <aoRecord.h>
+
+#include <epicsExport.h>
+
+/*
+ * Aggregate N inputs without a chain of calc records.
+ *
+ * Input ao records (DTYP "Sum Input", OUT "@<group> <index>")
+ * store directly into a contiguous buffer owned by the group.
+ * Statistic ai records (DTYP "Sum", INP "@<group> <sum|min|max|mean>")
+ * are scanned (I/O Intr) when any input changes.  All statistics are
+ * computed in one pass over the buffer.
+ */
+
+enum sumStat {sumStatSum, sumStatMin, sumStatMax, sumStatMean};
+
+struct sumGroup {
+  ELLNODE node;
+  char name[40];
+  unsigned nin;
+  epicsMutexId lock;
+  IOSCANPVT scan;
+
+  double *buf; /* nin input values */
+  int dirty;   /* buf changed since last compute */
+  double stat[4]; /* indexed by enum sumStat */
+};
+
+/* Per record private of input records */
+struct sumInput {
+  struct sumGroup* grp;
+  unsigned idx;
+};
+
+/* Per record private of statistic records */
+struct sumOutput {
+  struct sumGroup* grp;
+  enum sumStat stat;
+};
+
+static ELLLIST groups = ELLLIST_INIT;
+
+static
+struct sumGroup* lookupGroup(const char* name)
+{
+  ELLNODE* node;
+
+  for(node=ellFirst(&groups); node; node=ellNext(node)){
+    struct sumGroup* grp = CONTAINER(node, struct sumGroup, node);
+    if(strcmp(grp->name, name)==0)
+      return grp;
+  }
+  return NULL;
+}
+
+void
+createSumGroup(const char* name, int nin)
+{
+  struct sumGroup* grp;
+
+  if(!name || nin<=0) {
+    epicsPrintf("Usage: createSumGroup <name> <number of inputs>\n");
+    return;
+  }
+  if(strlen(name)>=sizeof(grp->name)) {
+    epicsPrintf("Group name too long\n");
+    return;
+  }
+  if(lookupGroup(name)) {
+    epicsPrintf("Group '%s' already exists\n", name);
+    return;
+  }
+
+  grp = callocMustSucceed(1, sizeof(*grp), "createSumGroup");
+  strcpy(grp->name, name);
+  grp->nin = nin;
+  grp->buf = callocMustSucceed(nin, sizeof(*grp->buf), "createSumGroup");
+  grp->lock = epicsMutexMustCreate();
+  grp->dirty = 1;
+  scanIoInit(&grp->scan);
+
+  ellAdd(&groups, &grp->node);
+}
+
+/* Compute all statistics in one pass.
+ * Four independent partial results let the compiler use
+ * SIMD instructions without relaxing floating point rules.
+ */
+static
+void sumCompute(struct sumGroup* grp)
+{
+  const double *x = grp->buf;
+  unsigned i, n = grp->nin, n4 = n&~3u;
+  double s0=0.0, s1=0.0, s2=0.0, s3=0.0;
+  double lo0, lo1, lo2, lo3, hi0, hi1, hi2, hi3;
+
+  lo0=lo1=lo2=lo3=hi0=hi1=hi2=hi3=x[0];
+
+  for(i=0; i<n4; i+=4) {
+    s0 += x[i];
+    s1 += x[i+1];
+    s2 += x[i+2];
+    s3 += x[i+3];
+    lo0 = x[i]  <lo0 ? x[i]   : lo0;
+    lo1 = x[i+1]<lo1 ? x[i+1] : lo1;
+    lo2 = x[i+2]<lo2 ? x[i+2] : lo2;
+    lo3 = x[i+3]<lo3 ? x[i+3] : lo3;
+    hi0 = x[i]  >hi0 ? x[i]   : hi0;
+    hi1 = x[i+1]>hi1 ? x[i+1] : hi1;
+    hi2 = x[i+2]>hi2 ? x[i+2] : hi2;
+    hi3 = x[i+3]>hi3 ? x[i+3] : hi3;
+  }
+  for(; i<n; i++) {
+    s0 += x[i];
+    lo0 = x[i]<lo0 ? x[i] : lo0;
+    hi0 = x[i]>hi0 ? x[i] : hi0;
+  }
+
+  lo0 = lo0<lo1 ? lo0 : lo1;
+  lo2 = lo2<lo3 ? lo2 : lo3;
+  hi0 = hi0>hi1 ? hi0 : hi1;
+  hi2 = hi2>hi3 ? hi2 : hi3;
+
+  grp->stat[sumStatSum] = (s0+s1)+(s2+s3);
+  grp->stat[sumStatMin] = lo0<lo2 ? lo0 : lo2;
+  grp->stat[sumStatMax] = hi0>hi2 ? hi0 : hi2;
+  grp->stat[sumStatMean] = grp->stat[sumStatSum]/n;
+  grp->dirty = 0;
+}
+
+/* Input records */
+
+static long init_record_ao(aoRecord *prec)
+{
+  struct sumInput* priv;
+  char name[40];
+  unsigned idx;
+
+  if(sscanf(prec->out.value.instio.string, "%39s %u", name, &idx)!=2) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "OUT must be \"@<group> <index>\"");
+    return S_db_badField;
+  }
+
+  priv = callocMustSucceed(1, sizeof(*priv), "sumInput");
+  priv->grp = lookupGroup(name);
+  priv->idx = idx;
+
+  if(!priv->grp || idx>=priv->grp->nin) {
+    free(priv);
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid group or index");
+    return S_dev_noDevice;
+  }
+
+  prec->dpvt = priv;
+
+  return 2; /* don't convert */
+}
+
+static long write_ao(aoRecord *prec)
+{
+  struct sumInput* priv = prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  epicsMutexMustLock(priv->grp->lock);
+  priv->grp->buf[priv->idx] = prec->oval;
+  priv->grp->dirty = 1;
+  epicsMutexUnlock(priv->grp->lock);
+
+  scanIoRequest(priv->grp->scan);
+
+  return 0;
+}
+
+/* Statistic records */
+
+static long init_record_ai(aiRecord *prec)
+{
+  static const char* const names[] = {"sum", "min", "max", "mean"};
+  struct sumOutput* priv;
+  char name[40], stat[8];
+  unsigned i;
+
+  if(sscanf(prec->inp.value.instio.string, "%39s %7s", name, stat)!=2) {
+    recGblRecordError(S_db_badField, (void*)prec,
+      "INP must be \"@<group> <sum|min|max|mean>\"");
+    return S_db_badField;
+  }
+
+  priv = callocMustSucceed(1, sizeof(*priv), "sumOutput");
+  priv->grp = lookupGroup(name);
+
+  for(i=0; i<NELEMENTS(names); i++) {
+    if(strcmp(stat, names[i])==0)
+      break;
+  }
+
+  if(!priv->grp || i==NELEMENTS(names)) {
+    free(priv);
+    recGblRecordError(S_dev_noDevice, (void*)prec,
+      "Not a valid group or statistic");
+    return S_dev_noDevice;
+  }
+  priv->stat = (enum sumStat)i;
+
+  prec->dpvt = priv;
+
+  return 0;
+}
+
+static long get_ioint_info(int dir,dbCommon* prec,IOSCANPVT* io)
+{
+  struct sumOutput* priv=prec->dpvt;
+
+  if(priv) {
+    *io = priv->grp->scan;
+  }
+  return 0;
+}
+
+static long read_ai(aiRecord *prec)
+{
+  struct sumOutput* priv=prec->dpvt;
+  if(!priv) {
+    (void)recGblSetSevr(prec, COMM_ALARM, INVALID_ALARM);
+    return 0;
+  }
+
+  epicsMutexMustLock(priv->grp->lock);
+  if(priv->grp->dirty)
+    sumCompute(priv->grp);
+  prec->val = priv->grp->stat[priv->stat];
+  epicsMutexUnlock(priv->grp->lock);
+
+  prec->udf = 0;
+
+  return 2; /* don't convert */
+}
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  write_ao;
+  DEVSUPFUN  special_linconv;
+} devAoSumInput = {
+  6, /* space for 6 functions */
+  NULL,
+  NULL,
+  init_record_ao,
+  NULL,
+  write_ao,
+  NULL
+};
+epicsExportAddress(dset,devAoSumInput);
+
+struct {
+  long num;
+  DEVSUPFUN  report;
+  DEVSUPFUN  init;
+  DEVSUPFUN  init_record;
+  DEVSUPFUN  get_ioint_info;
+  DEVSUPFUN  read_ai;
+  DEVSUPFUN  special_linconv;
+} devAiSum = {
+  6, /* space for 6 functions */
+  NULL,
+  NULL,
+  init_record_ai,
+  get_ioint_info,
+  read_ai,
+  NULL
+};
+epicsExportAddress(dset,devAiSum);
+
+static const iocshArg createSumGroupArg0 = { "name", iocshArgString };
+static const iocshArg createSumGroupArg1 = { "# of inputs", iocshArgInt };
+static const iocshArg * const createSumGroupArgs[2] =
+{ &createSumGroupArg0, &createSumGroupArg1 };
+static const iocshFuncDef createSumGroupFuncDef =
+{ "createSumGroup", 2, createSumGroupArgs };
+static void createSumGroupCallFunc(const iocshArgBuf *args)
+{
+  createSumGroup(args[0].sval,args[1].ival);
+}
+
+void sumGroupRegister(void)
+{
+  iocshRegister(&createSumGroupFuncDef, createSumGroupCallFunc);
+}
+epicsExportRegistrar(sumGroupRegister);
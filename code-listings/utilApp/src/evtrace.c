@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <ellLib.h>
+#include <dbDefs.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsVersion.h>
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,15,0,1)
+#  define USE_ATOMIC
+#  include <epicsAtomic.h>
+#endif
+#endif
+
+#include "evtrace.h"
+
+#include <epicsExport.h>
+
+struct evTraceEvent {
+  unsigned long long ticks;
+  const char* name;
+  const char* arg;
+  char phase;
+};
+
+/* One ring per thread.  Only the owning thread writes. */
+struct evTraceRing {
+  ELLNODE node;
+  char* thread;
+  unsigned tid;
+  unsigned size; /* power of 2 */
+  size_t head; /* total events recorded.  Written only by the owner */
+  size_t dumped; /* events already dumped.  Used only by evTraceDump() */
+  struct evTraceEvent* events;
+};
+
+volatile int evTraceEnabled;
+
+/* Events per thread.  Read when a thread records its first event. */
+int evTraceSize = 4096;
+epicsExportAddress(int, evTraceSize);
+
+static ELLLIST rings = ELLLIST_INIT;
+static epicsMutexId ringsLock;
+static epicsThreadPrivateId ringKey;
+static epicsThreadOnceId evTraceOnce = EPICS_THREAD_ONCE_INIT;
+
+/* Clock calibration, from the last evTraceOn() */
+static unsigned long long startTicks;
+static epicsTimeStamp startTime;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static __inline__ unsigned long long evTraceTicks(void)
+{
+  unsigned lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((unsigned long long)hi << 32) | lo;
+}
+#else
+static unsigned long long evTraceTicks(void)
+{
+  epicsTimeStamp now;
+  epicsTimeGetCurrent(&now);
+  return now.secPastEpoch*1000000000ULL + now.nsec;
+}
+#endif
+
+static
+void evTraceInit(void* unused)
+{
+  ringsLock = epicsMutexMustCreate();
+  ringKey = epicsThreadPrivateCreate();
+}
+
+static
+struct evTraceRing* evTraceRingSelf(void)
+{
+  struct evTraceRing* ring = epicsThreadPrivateGet(ringKey);
+
+  if(!ring) {
+    ring = callocMustSucceed(1, sizeof(*ring), "evTraceRing");
+    for(ring->size=1; (int)ring->size<evTraceSize; ring->size<<=1) {}
+    ring->events = callocMustSucceed(ring->size, sizeof(*ring->events), "evTraceRing");
+    ring->thread = epicsStrDup(epicsThreadGetNameSelf());
+
+    epicsMutexMustLock(ringsLock);
+    ring->tid = ellCount(&rings)+1;
+    ellAdd(&rings, &ring->node);
+    epicsMutexUnlock(ringsLock);
+
+    epicsThreadPrivateSet(ringKey, ring);
+  }
+  return ring;
+}
+
+void evTraceRecord(char phase, const char* name, const char* arg)
+{
+  struct evTraceRing* ring = evTraceRingSelf();
+  size_t head = ring->head;
+  struct evTraceEvent* ev = &ring->events[head & (ring->size-1)];
+
+  ev->ticks = evTraceTicks();
+  ev->name = name;
+  ev->arg = arg;
+  ev->phase = phase;
+#ifdef USE_ATOMIC
+  /* the event is complete before the new head is seen */
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicSetSizeT(&ring->head, head+1);
+#else
+  ring->head = head+1;
+#endif
+}
+
+/* Read the head of another thread's ring */
+static
+size_t evTraceHead(struct evTraceRing* ring)
+{
+  size_t head;
+#ifdef USE_ATOMIC
+  head = epicsAtomicGetSizeT(&ring->head);
+  epicsAtomicReadMemoryBarrier();
+#else
+  head = *(volatile size_t*)&ring->head;
+#endif
+  return head;
+}
+
+/* Write 's' as a JSON string */
+static
+void evTracePutString(FILE* fp, const char* s)
+{
+  fputc('"', fp);
+  for(; *s; s++) {
+    if(*s=='"' || *s=='\\')
+      fprintf(fp, "\\%c", *s);
+    else if((unsigned char)*s < 0x20)
+      fprintf(fp, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+void evTraceOn(void)
+{
+  epicsThreadOnce(&evTraceOnce, &evTraceInit, NULL);
+  startTicks = evTraceTicks();
+  epicsTimeGetCurrent(&startTime);
+  evTraceEnabled = 1;
+}
+
+void evTraceOff(void)
+{
+  evTraceEnabled = 0;
+}
+
+/* Stop recording and write every ring to 'fname' */
+void evTraceDump(const char* fname)
+{
+  FILE* fp;
+  ELLNODE* node;
+  epicsTimeStamp now;
+  unsigned long long nowTicks;
+  double usPerTick, elapsed;
+  int first = 1;
+
+  if(!fname || !*fname) {
+    printf("Usage: evTraceDump(\"file.json\")\n");
+    return;
+  }
+
+  evTraceOff();
+  epicsThreadOnce(&evTraceOnce, &evTraceInit, NULL);
+  /* let threads finish an event in progress */
+  epicsThreadSleep(0.01);
+
+  nowTicks = evTraceTicks();
+  epicsTimeGetCurrent(&now);
+  elapsed = epicsTimeDiffInSeconds(&now, &startTime);
+  usPerTick = (nowTicks>startTicks && elapsed>0.0) ?
+                elapsed*1e6/(double)(nowTicks-startTicks) : 1e-3;
+
+  fp = fopen(fname, "w");
+  if(!fp) {
+    printf("Can't open %s\n", fname);
+    return;
+  }
+
+  fprintf(fp, "{\"traceEvents\":[\n");
+
+  epicsMutexMustLock(ringsLock);
+  for(node=ellFirst(&rings); node; node=ellNext(node)) {
+    struct evTraceRing* ring = CONTAINER(node, struct evTraceRing, node);
+    /* The owner may still be recording, so never write its index.
+     * Dump from our own cursor up to a snapshot of its head.
+     */
+    size_t head = evTraceHead(ring);
+    size_t i = ring->dumped;
+
+    if(head - i > ring->size)
+      i = head - ring->size; /* older events were overwritten */
+
+    fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":",
+            first ? "" : ",\n", ring->tid);
+    evTracePutString(fp, ring->thread);
+    fprintf(fp, "}}");
+    first = 0;
+
+    for(; i<head; i++) {
+      struct evTraceEvent ev = ring->events[i & (ring->size-1)];
+      double ts;
+
+      /* skip a slot the owner overwrote while we copied it */
+      if(evTraceHead(ring) - i > ring->size)
+        continue;
+
+      ts = ((double)ev.ticks - (double)startTicks)*usPerTick;
+
+      fprintf(fp, ",\n{\"name\":");
+      evTracePutString(fp, ev.name);
+      fprintf(fp, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+              ev.phase, ts, ring->tid);
+      if(ev.phase=='i')
+        fprintf(fp, ",\"s\":\"t\"");
+      if(ev.arg) {
+        fprintf(fp, ",\"args\":{\"arg\":");
+        evTracePutString(fp, ev.arg);
+        fprintf(fp, "}");
+      }
+      fprintf(fp, "}");
+    }
+    ring->dumped = head;
+  }
+  epicsMutexUnlock(ringsLock);
+
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+  printf("Wrote %s\n", fname);
+}
+
+static const iocshFuncDef evTraceOnFuncDef = { "evTraceOn", 0, NULL };
+static void evTraceOnCallFunc(const iocshArgBuf *args)
+{
+  evTraceOn();
+}
+
+static const iocshFuncDef evTraceOffFuncDef = { "evTraceOff", 0, NULL };
+static void evTraceOffCallFunc(const iocshArgBuf *args)
+{
+  evTraceOff();
+}
+
+static const iocshArg evTraceDumpArg0 = { "file name", iocshArgString };
+static const iocshArg * const evTraceDumpArgs[1] = { &evTraceDumpArg0 };
+static const iocshFuncDef evTraceDumpFuncDef = { "evTraceDump", 1, evTraceDumpArgs };
+static void evTraceDumpCallFunc(const iocshArgBuf *args)
+{
+  evTraceDump(args[0].sval);
+}
+
+void evTraceRegister(void)
+{
+  iocshRegister(&evTraceOnFuncDef, evTraceOnCallFunc);
+  iocshRegister(&evTraceOffFuncDef, evTraceOffCallFunc);
+  iocshRegister(&evTraceDumpFuncDef, evTraceDumpCallFunc);
+}
+epicsExportRegistrar(evTraceRegister);
@@ -0,0 +1,46 @@
+
+#ifndef EVTRACE_H
+#define EVTRACE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary event trace for device support hot paths.
+ *
+ * Each thread records fixed size events, with a CPU timestamp,
+ * into its own ring.  Older events are overwritten.
+ * evTraceOn() and evTraceOff() start and stop recording, and
+ * evTraceDump() writes all rings in the Chrome trace event JSON
+ * format (chrome://tracing, Perfetto).
+ *
+ * While stopped each EVTRACE_*() costs one test of evTraceEnabled.
+ * Define EVTRACE_DISABLE to compile them out.
+ *
+ * 'name' and 'arg' must be strings which are never freed,
+ * like literals and record names.
+ */
+
+extern volatile int evTraceEnabled;
+
+void evTraceRecord(char phase, const char* name, const char* arg);
+
+#ifdef EVTRACE_DISABLE
+#  define EVTRACE_EVENT(PH, NAME, ARG) do {} while(0)
+#else
+#  define EVTRACE_EVENT(PH, NAME, ARG) \
+     do { if(evTraceEnabled) evTraceRecord(PH, NAME, ARG); } while(0)
+#endif
+
+/* Start and end of a duration */
+#define EVTRACE_BEGIN(NAME, ARG) EVTRACE_EVENT('B', NAME, ARG)
+#define EVTRACE_END(NAME, ARG)   EVTRACE_EVENT('E', NAME, ARG)
+/* A single point in time */
+#define EVTRACE_MARK(NAME, ARG)  EVTRACE_EVENT('i', NAME, ARG)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVTRACE_H */
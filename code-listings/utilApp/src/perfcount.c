@@ -0,0 +1,260 @@
+/* Linux needs this for sched_getcpu() */
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <ellLib.h>
+#include <dbDefs.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsVersion.h>
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+#ifdef EPICS_VERSION_INT
+#if EPICS_VERSION_INT>=VERSION_INT(3,15,0,1)
+#  define USE_ATOMIC
+#  include <epicsAtomic.h>
+#endif
+#endif
+
+#include "perfcount.h"
+
+#include <epicsExport.h>
+
+/* Slots per counter.  CPUs beyond this share slots. */
+#define PERF_NSLOTS 16
+#define PERF_LINE 64
+
+struct perfSlot {
+  size_t count;
+  char pad[PERF_LINE-sizeof(size_t)];
+};
+
+struct perfCounter {
+  struct perfSlot slot[PERF_NSLOTS]; /* first, for alignment */
+  ELLNODE node;
+  char* name;
+
+  /* for rates.  Guarded by countersLock */
+  size_t dumpCount;
+  epicsTimeStamp created;
+};
+
+static ELLLIST counters = ELLLIST_INIT;
+static epicsMutexId countersLock;
+static epicsThreadOnceId perfOnce = EPICS_THREAD_ONCE_INIT;
+
+static
+void perfInit(void* unused)
+{
+  countersLock = epicsMutexMustCreate();
+}
+
+struct perfCounter* perfCounterGet(const char* name)
+{
+  ELLNODE* node;
+  struct perfCounter* cnt;
+  void* mem;
+
+  epicsThreadOnce(&perfOnce, &perfInit, NULL);
+
+  epicsMutexMustLock(countersLock);
+  for(node=ellFirst(&counters); node; node=ellNext(node)) {
+    cnt = CONTAINER(node, struct perfCounter, node);
+    if(strcmp(cnt->name, name)==0) {
+      epicsMutexUnlock(countersLock);
+      return cnt;
+    }
+  }
+
+  /* align to a cache line.  Never freed. */
+  mem = callocMustSucceed(1, sizeof(*cnt)+PERF_LINE, "perfCounterGet");
+  cnt = (struct perfCounter*)(((size_t)mem + PERF_LINE-1) & ~(size_t)(PERF_LINE-1));
+  cnt->name = epicsStrDup(name);
+  epicsTimeGetCurrent(&cnt->created);
+  ellAdd(&counters, &cnt->node);
+  epicsMutexUnlock(countersLock);
+
+  return cnt;
+}
+
+void perfCounterAdd(struct perfCounter* cnt, size_t n)
+{
+  unsigned cpu = 0;
+#ifdef __linux__
+  int c = sched_getcpu();
+  if(c>=0)
+    cpu = (unsigned)c % PERF_NSLOTS;
+#endif
+#ifdef USE_ATOMIC
+  epicsAtomicAddSizeT(&cnt->slot[cpu].count, n);
+#else
+  /* may rarely lose counts when threads share a slot */
+  cnt->slot[cpu].count += n;
+#endif
+}
+
+size_t perfCounterRead(const struct perfCounter* cnt)
+{
+  size_t sum = 0;
+  unsigned i;
+  for(i=0; i<PERF_NSLOTS; i++) {
+#ifdef USE_ATOMIC
+    sum += epicsAtomicGetSizeT(&cnt->slot[i].count);
+#else
+    sum += cnt->slot[i].count;
+#endif
+  }
+  return sum;
+}
+
+void perfCounterReport(const char* prefix, int level)
+{
+  ELLNODE* node;
+  epicsTimeStamp now;
+  size_t plen = prefix ? strlen(prefix) : 0;
+
+  epicsThreadOnce(&perfOnce, &perfInit, NULL);
+  epicsTimeGetCurrent(&now);
+
+  epicsMutexMustLock(countersLock);
+  for(node=ellFirst(&counters); node; node=ellNext(node)) {
+    struct perfCounter* cnt = CONTAINER(node, struct perfCounter, node);
+    size_t total;
+    double period;
+
+    if(plen && strncmp(cnt->name, prefix, plen)!=0)
+      continue;
+
+    total = perfCounterRead(cnt);
+    period = epicsTimeDiffInSeconds(&now, &cnt->created);
+
+    /* average since creation, so reports don't disturb each other */
+    printf(" %s = %lu (%.1f/sec)\n", cnt->name, (unsigned long)total,
+           period>0 ? total/period : 0.0);
+  }
+  epicsMutexUnlock(countersLock);
+}
+
+/* Periodic dump to a file */
+struct perfDump {
+  char* fname;
+  double period;
+  int json;
+};
+
+static
+void perfDumpOnce(struct perfDump* dump, double elapsed)
+{
+  FILE* fp;
+  ELLNODE* node;
+  epicsTimeStamp now;
+  char stamp[40];
+  int first = 1;
+
+  /* CSV is appended, JSON holds only the latest values */
+  fp = fopen(dump->fname, dump->json ? "w" : "a");
+  if(!fp) {
+    errlogPrintf("perfCountersDump: can't open %s\n", dump->fname);
+    return;
+  }
+
+  epicsTimeGetCurrent(&now);
+  epicsTimeToStrftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S.%03f", &now);
+
+  if(dump->json)
+    fprintf(fp, "{\"time\":\"%s\",\"counters\":{", stamp);
+
+  epicsMutexMustLock(countersLock);
+  for(node=ellFirst(&counters); node; node=ellNext(node)) {
+    struct perfCounter* cnt = CONTAINER(node, struct perfCounter, node);
+    size_t total = perfCounterRead(cnt);
+    double rate = elapsed>0 ? (total-cnt->dumpCount)/elapsed : 0.0;
+
+    if(dump->json)
+      fprintf(fp, "%s\n \"%s\":{\"count\":%lu,\"rate\":%.3f}",
+              first ? "" : ",", cnt->name, (unsigned long)total, rate);
+    else
+      fprintf(fp, "%s,%s,%lu,%.3f\n", stamp, cnt->name, (unsigned long)total, rate);
+
+    first = 0;
+    cnt->dumpCount = total;
+  }
+  epicsMutexUnlock(countersLock);
+
+  if(dump->json)
+    fprintf(fp, "\n}}\n");
+  fclose(fp);
+}
+
+static
+void perfDumpWorker(void* raw)
+{
+  struct perfDump* dump = raw;
+  double elapsed = 0.0;
+
+  while(1) {
+    perfDumpOnce(dump, elapsed);
+    epicsThreadSleep(dump->period);
+    elapsed = dump->period;
+  }
+}
+
+void perfCountersDump(const char* fname, double period, const char* format)
+{
+  struct perfDump* dump;
+
+  if(!fname || !*fname || period<=0.0) {
+    printf("Usage: perfCountersDump(\"file\", period, \"csv|json\")\n");
+    return;
+  }
+
+  epicsThreadOnce(&perfOnce, &perfInit, NULL);
+
+  dump = callocMustSucceed(1, sizeof(*dump), "perfCountersDump");
+  dump->fname = epicsStrDup(fname);
+  dump->period = period;
+  dump->json = format && strcmp(format, "json")==0;
+
+  epicsThreadMustCreate("perfdump", epicsThreadPriorityLow,
+                        epicsThreadGetStackSize(epicsThreadStackSmall),
+                        &perfDumpWorker, dump);
+}
+
+static const iocshArg perfCountersArg0 = { "prefix", iocshArgString };
+static const iocshArg * const perfCountersArgs[1] = { &perfCountersArg0 };
+static const iocshFuncDef perfCountersFuncDef = { "perfCounters", 1, perfCountersArgs };
+static void perfCountersCallFunc(const iocshArgBuf *args)
+{
+  perfCounterReport(args[0].sval, 0);
+}
+
+static const iocshArg perfCountersDumpArg0 = { "file name", iocshArgString };
+static const iocshArg perfCountersDumpArg1 = { "period", iocshArgDouble };
+static const iocshArg perfCountersDumpArg2 = { "csv|json", iocshArgString };
+static const iocshArg * const perfCountersDumpArgs[3] =
+{ &perfCountersDumpArg0, &perfCountersDumpArg1, &perfCountersDumpArg2 };
+static const iocshFuncDef perfCountersDumpFuncDef = { "perfCountersDump", 3, perfCountersDumpArgs };
+static void perfCountersDumpCallFunc(const iocshArgBuf *args)
+{
+  perfCountersDump(args[0].sval, args[1].dval, args[2].sval);
+}
+
+void perfCounterRegister(void)
+{
+  iocshRegister(&perfCountersFuncDef, perfCountersCallFunc);
+  iocshRegister(&perfCountersDumpFuncDef, perfCountersDumpCallFunc);
+}
+epicsExportRegistrar(perfCounterRegister);
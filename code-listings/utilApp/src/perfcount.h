@@ -0,0 +1,44 @@
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H 1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Registry of named event counters, shared by device supports.
+ *
+ * Names are "<dset>.<event>", like "devAiPrngIntr.samples".
+ * Each counter has one slot per CPU, each in its own cache line,
+ * so threads on different CPUs don't contend on increment.
+ * Reading sums the slots.
+ */
+
+struct perfCounter;
+
+/* Find or create a counter.  Call during initialization, not from
+ * a hot path.
+ */
+struct perfCounter* perfCounterGet(const char* name);
+
+/* Add 'n' to a counter */
+void perfCounterAdd(struct perfCounter* cnt, size_t n);
+
+#define perfCounterInc(CNT) perfCounterAdd(CNT, 1)
+
+/* Current total of a counter */
+size_t perfCounterRead(const struct perfCounter* cnt);
+
+/* Print counters beginning with 'prefix' with average rates since
+ * each was created.  For use by dset report functions.
+ */
+void perfCounterReport(const char* prefix, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERFCOUNT_H */
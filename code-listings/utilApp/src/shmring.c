@@ -0,0 +1,189 @@
+/* for clock_gettime() and shm_open() */
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shmring.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <time.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  define SHMRING_POSIX
+#endif
+
+struct shmRing {
+  struct shmRingHeader* hdr;
+  struct shmRingEntry* entries;
+  uint64_t mask;
+  size_t size;
+};
+
+#ifdef SHMRING_POSIX
+
+static
+struct shmRing* shmRingMap(int fd, size_t size, int prot)
+{
+  struct shmRing* ring;
+  void* mem = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+  close(fd);
+  if(mem==MAP_FAILED)
+    return NULL;
+
+  ring = calloc(1, sizeof(*ring));
+  if(!ring) {
+    munmap(mem, size);
+    return NULL;
+  }
+  ring->hdr = mem;
+  ring->entries = (struct shmRingEntry*)(ring->hdr+1);
+  ring->size = size;
+  return ring;
+}
+
+struct shmRing* shmRingCreate(const char* name, unsigned capacity)
+{
+  struct shmRing* ring;
+  unsigned cap;
+  size_t size;
+  int fd;
+
+  for(cap=1; cap<capacity; cap<<=1) {}
+  size = sizeof(struct shmRingHeader) + cap*sizeof(struct shmRingEntry);
+
+  shm_unlink(name); /* start fresh, readers of an old ring keep it */
+  fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0644);
+  if(fd<0) {
+    perror("shm_open");
+    return NULL;
+  }
+  if(ftruncate(fd, size)!=0) {
+    perror("ftruncate");
+    close(fd);
+    return NULL;
+  }
+
+  ring = shmRingMap(fd, size, PROT_READ|PROT_WRITE);
+  if(!ring)
+    return NULL;
+
+  /* new memory is zero, so every entry has seq 0 */
+  ring->hdr->capacity = cap;
+  ring->hdr->entrysize = sizeof(struct shmRingEntry);
+  ring->hdr->version = SHMRING_VERSION;
+  __atomic_store_n(&ring->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+  ring->mask = cap-1;
+  return ring;
+}
+
+void shmRingPut(struct shmRing* ring, uint32_t source, uint32_t channel, double value)
+{
+  uint64_t n = __atomic_fetch_add(&ring->hdr->head, 1, __ATOMIC_RELAXED);
+  struct shmRingEntry* ent = &ring->entries[n & ring->mask];
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  __atomic_store_n(&ent->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  ent->sec = now.tv_sec;
+  ent->nsec = now.tv_nsec;
+  ent->source = source;
+  ent->channel = channel;
+  ent->value = value;
+
+  __atomic_store_n(&ent->seq, n+1, __ATOMIC_RELEASE);
+}
+
+struct shmRing* shmRingOpen(const char* name)
+{
+  struct shmRing* ring;
+  struct shmRingHeader hdr;
+  int fd = shm_open(name, O_RDONLY, 0);
+
+  if(fd<0)
+    return NULL;
+
+  if(read(fd, &hdr, sizeof(hdr))!=(ssize_t)sizeof(hdr) ||
+     hdr.magic!=SHMRING_MAGIC || hdr.version!=SHMRING_VERSION ||
+     hdr.entrysize!=sizeof(struct shmRingEntry))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  ring = shmRingMap(fd, sizeof(hdr) + hdr.capacity*sizeof(struct shmRingEntry), PROT_READ);
+  if(ring)
+    ring->mask = hdr.capacity-1;
+  return ring;
+}
+
+uint64_t shmRingHead(const struct shmRing* ring)
+{
+  return __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+int shmRingNext(const struct shmRing* ring, uint64_t* cursor, struct shmRingEntry* out)
+{
+  uint64_t n = *cursor;
+  const struct shmRingEntry* ent = &ring->entries[n & ring->mask];
+  uint64_t s1, s2, head;
+
+  s1 = __atomic_load_n(&ent->seq, __ATOMIC_ACQUIRE);
+  if(s1==n+1) {
+    memcpy(out, ent, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    s2 = __atomic_load_n(&ent->seq, __ATOMIC_RELAXED);
+    if(s2==s1) {
+      *cursor = n+1;
+      return 1;
+    }
+  }
+
+  head = shmRingHead(ring);
+  if(head <= n+ring->mask+1 && (s1==0 || s1<n+1))
+    return 0; /* not written yet */
+
+  /* overwritten.  Continue from the oldest which may still be intact */
+  *cursor = head > ring->mask+1 ? head-(ring->mask+1)/2 : 0;
+  return -1;
+}
+
+void shmRingClose(struct shmRing* ring)
+{
+  if(!ring)
+    return;
+  munmap(ring->hdr, ring->size);
+  free(ring);
+}
+
+#else /* SHMRING_POSIX */
+
+struct shmRing* shmRingCreate(const char* name, unsigned capacity)
+{
+  fprintf(stderr, "shmRing: not implemented on this target\n");
+  return NULL;
+}
+
+void shmRingPut(struct shmRing* ring, uint32_t source, uint32_t channel, double value) {}
+
+struct shmRing* shmRingOpen(const char* name) { return NULL; }
+
+uint64_t shmRingHead(const struct shmRing* ring) { return 0; }
+
+int shmRingNext(const struct shmRing* ring, uint64_t* cursor, struct shmRingEntry* out)
+{
+  return 0;
+}
+
+void shmRingClose(struct shmRing* ring) {}
+
+#endif /* SHMRING_POSIX */
@@ -0,0 +1,69 @@
+
+#ifndef SHMRING_H
+#define SHMRING_H 1
+
+#include <stdint.h>
+
+/*
+ * A ring of samples in POSIX shared memory, for consumers on the same host.
+ *
+ * Writers (in the IOC) claim entries with an atomic increment of 'head',
+ * so they never block.  Any number of readers, in other processes,
+ * follow with their own cursor.  A reader which falls more than
+ * 'capacity' entries behind is told, and skips ahead.
+ *
+ * Each entry has a sequence number, which is its index + 1 once
+ * written, and 0 while being written.  Readers check it before and
+ * after copying an entry.
+ *
+ * This file and shmring.c don't depend on EPICS, so readers only need
+ * these two files (or libshmring).  Needs GCC compatible atomics.
+ */
+
+#define SHMRING_MAGIC 0x53524e47 /* "SRNG" */
+#define SHMRING_VERSION 1
+
+struct shmRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity; /* entries, a power of 2 */
+  uint32_t entrysize;
+  uint64_t head; /* entries claimed by writers so far */
+  char pad[40];
+};
+
+struct shmRingEntry {
+  uint64_t seq;
+  int64_t sec;  /* CLOCK_REALTIME when written */
+  uint32_t nsec;
+  uint32_t source;  /* createPrng() id, or msim axis id */
+  uint32_t channel;
+  uint32_t pad;
+  double value;
+};
+
+struct shmRing;
+
+/* Create (or replace) the ring 'name', like "/prng".  Returns NULL on error. */
+struct shmRing* shmRingCreate(const char* name, unsigned capacity);
+
+/* Append one sample.  Safe to call from any thread. */
+void shmRingPut(struct shmRing* ring, uint32_t source, uint32_t channel, double value);
+
+/* Attach to an existing ring, read only.  Returns NULL on error. */
+struct shmRing* shmRingOpen(const char* name);
+
+/* Index of the next entry to be written.  Start a cursor here
+ * to see only new entries.
+ */
+uint64_t shmRingHead(const struct shmRing* ring);
+
+/* Copy the entry at '*cursor' into 'out'.
+ * Returns 1 and advances the cursor, 0 if that entry isn't written yet,
+ * or -1 if it was overwritten, after moving the cursor to the oldest entry.
+ */
+int shmRingNext(const struct shmRing* ring, uint64_t* cursor, struct shmRingEntry* out);
+
+void shmRingClose(struct shmRing* ring);
+
+#endif /* SHMRING_H */
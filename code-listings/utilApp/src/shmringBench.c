@@ -0,0 +1,146 @@
+/* Benchmark of shmring.c
+ *
+ *  shmringBench              One writer and one reader thread in this process.
+ *                            Reports the cost per sample and reader lag.
+ *  shmringBench /name [sec]  Follow the ring of a running IOC and report
+ *                            rate, lag and overruns.
+ */
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "shmring.h"
+
+#define NSAMPLES 10000000
+#define CAPACITY 65536
+
+struct lagStats {
+  unsigned long count, overruns;
+  double sum, max; /* lag in sec. */
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/* Read until 'until' (absolute time), or 'stop' is set and the ring is empty */
+static void follow(struct shmRing* ring, double until, volatile int* stop,
+                   struct lagStats* lag)
+{
+  uint64_t cursor = shmRingHead(ring);
+  struct shmRingEntry ent;
+
+  memset(lag, 0, sizeof(*lag));
+  while(1) {
+    int ret = shmRingNext(ring, &cursor, &ent);
+    if(ret==1) {
+      double l = now() - (ent.sec + ent.nsec*1e-9);
+      lag->count++;
+      lag->sum += l;
+      if(l>lag->max)
+        lag->max = l;
+    } else if(ret<0) {
+      lag->overruns++;
+    } else if((stop && *stop) || (until>0 && now()>until)) {
+      break;
+    }
+  }
+}
+
+static void printLag(const struct lagStats* lag, double elapsed)
+{
+  printf("read %lu samples (%.0f/sec), %lu overruns\n",
+         lag->count, lag->count/elapsed, lag->overruns);
+  if(lag->count)
+    printf("lag mean %.2f us, max %.2f us\n",
+           lag->sum/lag->count*1e6, lag->max*1e6);
+}
+
+struct selfTest {
+  struct shmRing* ring;
+  volatile int stop;
+  struct lagStats lag;
+};
+
+static void* reader(void* raw)
+{
+  struct selfTest* test = raw;
+  struct shmRing* ring = shmRingOpen("/shmringbench");
+
+  if(!ring) {
+    fprintf(stderr, "reader can't open ring\n");
+    return NULL;
+  }
+  follow(ring, 0, &test->stop, &test->lag);
+  shmRingClose(ring);
+  return NULL;
+}
+
+static int selfTest(void)
+{
+  struct selfTest test;
+  pthread_t tid;
+  double start, elapsed;
+  unsigned long i;
+
+  memset(&test, 0, sizeof(test));
+  test.ring = shmRingCreate("/shmringbench", CAPACITY);
+  if(!test.ring)
+    return 1;
+
+  pthread_create(&tid, NULL, &reader, &test);
+  usleep(100000); /* let the reader attach */
+
+  start = now();
+  for(i=0; i<NSAMPLES; i++)
+    shmRingPut(test.ring, 0, 0, (double)i);
+  elapsed = now()-start;
+
+  test.stop = 1;
+  pthread_join(tid, NULL);
+
+  printf("wrote %d samples in %.3f sec, %.1f ns/sample\n",
+         NSAMPLES, elapsed, elapsed/NSAMPLES*1e9);
+  printLag(&test.lag, elapsed);
+
+  shmRingClose(test.ring);
+  shm_unlink("/shmringbench");
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  struct shmRing* ring;
+  struct lagStats lag;
+  double period = 10.0, start;
+
+  if(argc<2)
+    return selfTest();
+
+  if(argc>2)
+    period = atof(argv[2]);
+
+  ring = shmRingOpen(argv[1]);
+  if(!ring) {
+    fprintf(stderr, "Can't open ring %s\n", argv[1]);
+    return 1;
+  }
+
+  start = now();
+  follow(ring, start+period, NULL, &lag);
+  printLag(&lag, now()-start);
+
+  shmRingClose(ring);
+  return 0;
+}
@@ -0,0 +1,336 @@
+/* Linux needs this for CPU_SET() and pthread_setaffinity_np() */
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <ellLib.h>
+#include <dbDefs.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+
+#ifdef __linux__
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+#include "threadplace.h"
+
+#include <epicsExport.h>
+
+struct threadPolicy {
+  ELLNODE node;
+  char* group;
+  char* cpus;
+  char* sched;
+  int prio;
+  int spread;
+  unsigned nthreads; /* placed so far, for spread */
+};
+
+static ELLLIST policies = ELLLIST_INIT;
+
+static
+struct threadPolicy* findPolicy(const char* group)
+{
+  ELLNODE* node;
+
+  for(node=ellFirst(&policies); node; node=ellNext(node)){
+    struct threadPolicy* pol = CONTAINER(node, struct threadPolicy, node);
+    if(strcmp(pol->group, group)==0)
+      return pol;
+  }
+  return NULL;
+}
+
+#ifdef __linux__
+
+/* Parse a CPU list like "0-3,6" */
+static
+int parseCPUs(const char* str, cpu_set_t* set)
+{
+  CPU_ZERO(set);
+  while(*str) {
+    char* end;
+    long first, last;
+
+    first = last = strtol(str, &end, 10);
+    if(end==str || first<0)
+      return -1;
+    str = end;
+    if(*str=='-') {
+      str++;
+      last = strtol(str, &end, 10);
+      if(end==str || last<first)
+        return -1;
+      str = end;
+    }
+    for(; first<=last && first<CPU_SETSIZE; first++)
+      CPU_SET(first, set);
+    if(*str==',')
+      str++;
+    else if(*str)
+      return -1;
+  }
+  return CPU_COUNT(set) ? 0 : -1;
+}
+
+static
+int placeThread(pthread_t tid, const char* cpus, const char* sched,
+                int prio, int spread, unsigned index)
+{
+  int ret;
+
+  if(cpus && cpus[0]) {
+    cpu_set_t set;
+
+    if(parseCPUs(cpus, &set)) {
+      errlogPrintf("Invalid CPU list '%s'\n", cpus);
+      return -1;
+    }
+
+    if(spread) {
+      /* keep only the index'th CPU of the set (modulo) */
+      int n = index % CPU_COUNT(&set), cpu;
+      for(cpu=0; cpu<CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &set))
+          continue;
+        if(n--==0) {
+          CPU_ZERO(&set);
+          CPU_SET(cpu, &set);
+          break;
+        }
+      }
+    }
+
+    ret = pthread_setaffinity_np(tid, sizeof(set), &set);
+    if(ret) {
+      errlogPrintf("Failed to set CPU affinity: %s\n", strerror(ret));
+      return -1;
+    }
+  }
+
+  if(sched && sched[0]) {
+    struct sched_param param;
+    int policy;
+
+    if(strcmp(sched, "FIFO")==0)
+      policy = SCHED_FIFO;
+    else if(strcmp(sched, "RR")==0)
+      policy = SCHED_RR;
+    else if(strcmp(sched, "OTHER")==0)
+      policy = SCHED_OTHER;
+    else {
+      errlogPrintf("Unknown scheduling policy '%s'.  Use FIFO, RR, or OTHER\n", sched);
+      return -1;
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = policy==SCHED_OTHER ? 0 : prio;
+
+    ret = pthread_setschedparam(tid, policy, &param);
+    if(ret) {
+      errlogPrintf("Failed to set scheduling policy: %s\n", strerror(ret));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+#endif /* __linux__ */
+
+void threadPlaceApply(epicsThreadId tid, const char* group)
+{
+  struct threadPolicy* pol = findPolicy(group);
+  unsigned index;
+
+  if(!pol)
+    return;
+  /* workers are started from iocInit hooks, one at a time */
+  index = pol->nthreads++;
+#ifdef __linux__
+  (void)placeThread(epicsThreadGetPosixThreadId(tid), pol->cpus, pol->sched,
+                    pol->prio, pol->spread, index);
+#else
+  (void)index;
+#endif
+}
+
+/* Define (or replace) the policy for a group of threads.
+ * eg. threadPolicy("prng", "2-7", "FIFO", 20, 1)
+ */
+void threadPolicy(const char* group, const char* cpus, const char* sched,
+                  int prio, int spread)
+{
+  struct threadPolicy* pol;
+
+  if(!group || !group[0]) {
+    printf("Usage: threadPolicy <group> <cpus> <FIFO|RR|OTHER> <prio> <spread>\n");
+    return;
+  }
+
+  pol = findPolicy(group);
+  if(!pol) {
+    pol = callocMustSucceed(1, sizeof(*pol), "threadPolicy");
+    pol->group = epicsStrDup(group);
+    ellAdd(&policies, &pol->node);
+  } else {
+    free(pol->cpus);
+    free(pol->sched);
+  }
+
+  pol->cpus = epicsStrDup(cpus ? cpus : "");
+  pol->sched = epicsStrDup(sched ? sched : "");
+  pol->prio = prio;
+  pol->spread = spread;
+}
+
+/* Apply a placement to an existing thread, by name.
+ * eg. threadPlace("cbHigh", "1", "FIFO", 50)
+ */
+void threadPlace(const char* name, const char* cpus, const char* sched, int prio)
+{
+  epicsThreadId tid;
+
+  if(!name || !name[0]) {
+    printf("Usage: threadPlace <thread name> <cpus> <FIFO|RR|OTHER> <prio>\n");
+    return;
+  }
+
+  tid = epicsThreadGetId(name);
+  if(!tid) {
+    printf("No thread named '%s'\n", name);
+    return;
+  }
+#ifdef __linux__
+  (void)placeThread(epicsThreadGetPosixThreadId(tid), cpus, sched, prio, 0, 0);
+#else
+  printf("Thread placement not supported on this target\n");
+#endif
+}
+
+struct jitterTest {
+  char* cpus;
+  char* sched;
+  int prio;
+  double period;
+  unsigned count;
+};
+
+static
+void jitterWorker(void* raw)
+{
+  struct jitterTest* test = raw;
+  double sum=0.0, sum2=0.0, lmin=1e9, lmax=0.0, mean;
+  unsigned i;
+
+#ifdef __linux__
+  if(placeThread(pthread_self(), test->cpus, test->sched, test->prio, 0, 0))
+    goto done;
+#endif
+
+  for(i=0; i<test->count; i++) {
+    epicsTimeStamp start, end;
+    double late;
+
+    epicsTimeGetCurrent(&start);
+    epicsThreadSleep(test->period);
+    epicsTimeGetCurrent(&end);
+
+    late = epicsTimeDiffInSeconds(&end, &start) - test->period;
+    sum += late;
+    sum2 += late*late;
+    if(late<lmin) lmin=late;
+    if(late>lmax) lmax=late;
+  }
+
+  mean = sum/test->count;
+  printf("Wakeup lateness over %u periods of %g sec (cpus='%s' sched='%s' prio=%d)\n",
+         test->count, test->period, test->cpus, test->sched, test->prio);
+  printf(" min %.1f us  mean %.1f us  max %.1f us  stddev %.1f us\n",
+         lmin*1e6, mean*1e6, lmax*1e6,
+         sqrt(fabs(sum2/test->count - mean*mean))*1e6);
+
+#ifdef __linux__
+done:
+#endif
+  free(test->cpus);
+  free(test->sched);
+  free(test);
+}
+
+/* Measure wakeup jitter of a thread with the given placement.
+ * Runs in the background and prints a summary when done.
+ */
+void threadJitter(const char* cpus, const char* sched, int prio,
+                  double period, int count)
+{
+  struct jitterTest* test;
+
+  if(period<=0.0)
+    period = 0.001;
+  if(count<=0)
+    count = 1000;
+
+  test = callocMustSucceed(1, sizeof(*test), "threadJitter");
+  test->cpus = epicsStrDup(cpus ? cpus : "");
+  test->sched = epicsStrDup(sched ? sched : "");
+  test->prio = prio;
+  test->period = period;
+  test->count = count;
+
+  epicsThreadMustCreate("jitter", epicsThreadPriorityMedium,
+                        epicsThreadGetStackSize(epicsThreadStackSmall),
+                        &jitterWorker, test);
+}
+
+static const iocshArg threadPolicyArg0 = { "group", iocshArgString };
+static const iocshArg threadPolicyArg1 = { "CPU list", iocshArgString };
+static const iocshArg threadPolicyArg2 = { "FIFO|RR|OTHER", iocshArgString };
+static const iocshArg threadPolicyArg3 = { "priority", iocshArgInt };
+static const iocshArg threadPolicyArg4 = { "spread", iocshArgInt };
+static const iocshArg * const threadPolicyArgs[5] =
+{ &threadPolicyArg0, &threadPolicyArg1, &threadPolicyArg2, &threadPolicyArg3, &threadPolicyArg4 };
+static const iocshFuncDef threadPolicyFuncDef =
+{ "threadPolicy", 5, threadPolicyArgs };
+static void threadPolicyCallFunc(const iocshArgBuf *args)
+{
+  threadPolicy(args[0].sval,args[1].sval,args[2].sval,args[3].ival,args[4].ival);
+}
+
+static const iocshArg threadPlaceArg0 = { "thread name", iocshArgString };
+static const iocshArg * const threadPlaceArgs[4] =
+{ &threadPlaceArg0, &threadPolicyArg1, &threadPolicyArg2, &threadPolicyArg3 };
+static const iocshFuncDef threadPlaceFuncDef =
+{ "threadPlace", 4, threadPlaceArgs };
+static void threadPlaceCallFunc(const iocshArgBuf *args)
+{
+  threadPlace(args[0].sval,args[1].sval,args[2].sval,args[3].ival);
+}
+
+static const iocshArg threadJitterArg3 = { "period", iocshArgDouble };
+static const iocshArg threadJitterArg4 = { "count", iocshArgInt };
+static const iocshArg * const threadJitterArgs[5] =
+{ &threadPolicyArg1, &threadPolicyArg2, &threadPolicyArg3, &threadJitterArg3, &threadJitterArg4 };
+static const iocshFuncDef threadJitterFuncDef =
+{ "threadJitter", 5, threadJitterArgs };
+static void threadJitterCallFunc(const iocshArgBuf *args)
+{
+  threadJitter(args[0].sval,args[1].sval,args[2].ival,args[3].dval,args[4].ival);
+}
+
+void threadPlaceRegister(void)
+{
+  iocshRegister(&threadPolicyFuncDef, threadPolicyCallFunc);
+  iocshRegister(&threadPlaceFuncDef, threadPlaceCallFunc);
+  iocshRegister(&threadJitterFuncDef, threadJitterCallFunc);
+}
+epicsExportRegistrar(threadPlaceRegister);
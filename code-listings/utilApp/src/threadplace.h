@@ -0,0 +1,22 @@
+
+#ifndef THREADPLACE_H
+#define THREADPLACE_H 1
+
+#include <epicsThread.h>
+
+/*
+ * Thread placement (CPU affinity and scheduling policy).
+ *
+ * Policies are defined by group name with the threadPolicy()
+ * IOCSH function before iocInit, and applied by device
+ * support to the worker threads it creates.
+ * Only implemented for Linux.  Elsewhere this does nothing.
+ */
+
+/* Apply the policy of 'group' (if any) to thread 'tid'.
+ * Threads are counted per group, over all callers, and
+ * the count selects one CPU of the set when the policy spreads.
+ */
+void threadPlaceApply(epicsThreadId tid, const char* group);
+
+#endif /* THREADPLACE_H */